@@ -0,0 +1,30 @@
+﻿#pragma once
+
+// 描画先を抽象化したもの
+// Direct2D でもソフトウェアラスタライザでも同じ描画処理を使えるように、Windows の型は使わない
+
+// 画面上の点
+struct GraphPoint {
+    float x;
+    float y;
+};
+
+// RGBA 色（各成分 0.0 ～ 1.0）
+struct GraphColor {
+    float r;
+    float g;
+    float b;
+    float a;
+};
+
+class GraphCanvas {
+public:
+    virtual ~GraphCanvas() {}
+
+    // 全体を塗りつぶす
+    virtual void Clear(GraphColor color) = 0;
+
+    // 点 (xs[i], ys[i]) を順に結んだ折れ線を描く
+    // 点は x と y の配列に分けて渡す（描画先の API が点の構造体を求めるなら、描画先の中で詰め直す）
+    virtual void DrawPolyline(const float* xs, const float* ys, int count, GraphColor color, float strokeWidth) = 0;
+};
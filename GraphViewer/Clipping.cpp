@@ -0,0 +1,61 @@
+﻿#include "Clipping.h"
+
+// C++ ライブラリ
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+namespace {
+    const uint8_t Inside = 0;
+    const uint8_t Above = 1;
+    const uint8_t Below = 2;
+
+    // 無限大は計算できないので、float の最大値にする
+    // 画面から見ればどちらも縦線なので、結果は変わらない
+    float Finite(float y)
+    {
+        const float limit = std::numeric_limits<float>::max();
+        return std::max(-limit, std::min(limit, y));
+    }
+
+    // a から b への線分が y = boundary を横切る点
+    GraphPoint Intersect(GraphPoint a, GraphPoint b, float boundary)
+    {
+        float ay = Finite(a.y);
+        float t = (boundary - ay) / (Finite(b.y) - ay);
+        return GraphPoint{ a.x + (b.x - a.x) * t, boundary };
+    }
+}
+
+void ClipPolyline(const float* xs, const float* ys, int count, float top, float bottom, FrameArena& arena, PointBuffer& out)
+{
+    out.Clear();
+    if (count <= 0) return;
+
+    // 先に全点を帯の上（1）、下（2）、中（0）に分類しておく
+    // 連続した y を比較するだけで分岐がないのでベクトル化できる
+    FrameArena::Scope scope(arena);
+    uint8_t* codes = arena.AllocateArray<uint8_t>(count);
+    for (int i = 0; i < count; i++) {
+        codes[i] = static_cast<uint8_t>((ys[i] < top) | ((ys[i] > bottom) << 1));
+    }
+
+    auto boundaryOf = [top, bottom](uint8_t code) { return code == Above ? top : bottom; };
+
+    if (codes[0] == Inside) out.Push(xs[0], ys[0]);
+
+    for (int i = 1; i < count; i++) {
+        uint8_t ca = codes[i - 1];
+        uint8_t cb = codes[i];
+
+        // 両端が同じ側の外にある線分は、まとめて読み飛ばす
+        if (ca & cb) continue;
+
+        // Liang–Barsky と同じく、線分が帯に入る点と出る点を求める
+        // 入る点は前に出た点と同じ境界の上にあるので、そのまま結べば境界に沿った線分になる
+        GraphPoint a = { xs[i - 1], ys[i - 1] };
+        GraphPoint b = { xs[i], ys[i] };
+        if (ca != Inside) out.Push(Intersect(a, b, boundaryOf(ca)));
+        out.Push(cb == Inside ? b : Intersect(a, b, boundaryOf(cb)));
+    }
+}
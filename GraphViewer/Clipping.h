@@ -0,0 +1,14 @@
+﻿#pragma once
+
+#include "Canvas.h"
+#include "FrameArena.h"
+#include "PointBuffer.h"
+
+// 折れ線を top <= y <= bottom の帯で切り取る
+// 帯の外を通る部分は、帯から出た点と戻った点を帯の境界に沿った 1 本の線分で結ぶ
+// 境界を画面から線の太さより十分外に置けば、見た目を変えずに描く点を減らせる
+//
+// 点 (xs[i], ys[i]) の折れ線を切り取って out に入れる（帯に入らなければ空になる）
+// out の容量は 2 * count 以上にする
+// 途中で使う点ごとの分類は arena から切り出し、終わったら返す
+void ClipPolyline(const float* xs, const float* ys, int count, float top, float bottom, FrameArena& arena, PointBuffer& out);
@@ -0,0 +1,397 @@
+﻿#include "CsvParser.h"
+
+// C++ ライブラリ
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define GRAPHVIEWER_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace {
+    // 1 スレッドに任せる最小のバイト数
+    // 小さいファイルはスレッドを作るほうが遅い
+    const size_t MinChunkBytes = 4 << 20;
+
+    // double でちょうど表せる 10 の累乗
+    const double ExactPowersOf10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const int MaxExactPower = 22;
+
+    // double でちょうど表せる整数の上限（2^53）
+    const uint64_t MaxExactMantissa = 9007199254740992ULL;
+
+    // uint64_t にあふれずに入る 10 進の桁数（先頭の 0 も数える）
+    const ptrdiff_t MaxMantissaDigits = 19;
+
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+
+#ifdef GRAPHVIEWER_SSE2
+    inline int CountTrailingZeros(unsigned int mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+#endif
+
+    // p から end までで最初の c の位置（なければ end）
+    // SSE2 が使えるときは 16 バイトずつまとめて比べる
+    const char* FindByte(const char* p, const char* end, char c)
+    {
+#ifdef GRAPHVIEWER_SSE2
+        const __m128i pattern = _mm_set1_epi8(c);
+        for (; end - p >= 16; p += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, pattern));
+            if (mask != 0) return p + CountTrailingZeros(static_cast<unsigned int>(mask));
+        }
+#endif
+        const void* found = std::memchr(p, c, end - p);
+        return found != nullptr ? static_cast<const char*>(found) : end;
+    }
+
+    // p から end までにある c の数
+    // 一致したバイトは 0xFF（-1）になるので、引くと 1 ずつ数えられる
+    // 255 回ごとに _mm_sad_epu8 で 64 ビットの合計に足し込む
+    size_t CountByte(const char* p, const char* end, char c)
+    {
+        size_t count = 0;
+#ifdef GRAPHVIEWER_SSE2
+        const __m128i pattern = _mm_set1_epi8(c);
+        const __m128i zero = _mm_setzero_si128();
+        while (end - p >= 16) {
+            __m128i counts = zero;
+            for (int i = 0; i < 255 && end - p >= 16; i++, p += 16) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(block, pattern));
+            }
+            __m128i sums = _mm_sad_epu8(counts, zero);
+            count += static_cast<size_t>(_mm_cvtsi128_si32(sums)) + static_cast<size_t>(_mm_cvtsi128_si32(_mm_srli_si128(sums, 8)));
+        }
+#endif
+        for (; p < end; p++) {
+            if (*p == c) count++;
+        }
+        return count;
+    }
+
+    inline bool IsDigit(char c)
+    {
+        return static_cast<unsigned char>(c - '0') < 10;
+    }
+
+    inline bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    // 区切り文字でない空白を飛ばす
+    const char* SkipSpaces(const char* p, const char* end, char delimiter)
+    {
+        while (p < end && IsSpace(*p) && *p != delimiter) p++;
+        return p;
+    }
+
+    // 1 行を読んで、先頭から最大 2 列の値を values に入れる
+    // 数値でない列は NaN にする
+    // 戻り値は列の数（空の行なら 0）
+    int ParseLine(const char* p, const char* lineEnd, char delimiter, double values[2])
+    {
+        const bool spaceDelimited = delimiter == ' ';
+        int fields = 0;
+
+        p = SkipSpaces(p, lineEnd, spaceDelimited ? '\0' : delimiter);
+        if (p >= lineEnd) return 0;
+
+        while (fields < 2) {
+            double value;
+            const char* next = ParseNumber(p, lineEnd, value);
+            const char* fieldEnd = spaceDelimited ? next : SkipSpaces(next, lineEnd, delimiter);
+
+            // 数値の後に区切り以外のものが続けば、数値の列ではない
+            bool terminated = fieldEnd >= lineEnd || *fieldEnd == delimiter || (spaceDelimited && IsSpace(*fieldEnd));
+            if (next == p || !terminated) {
+                value = NaN;
+                if (spaceDelimited) {
+                    while (fieldEnd < lineEnd && !IsSpace(*fieldEnd)) fieldEnd++;
+                } else {
+                    fieldEnd = FindByte(fieldEnd, lineEnd, delimiter);
+                }
+            }
+            values[fields++] = value;
+
+            if (fieldEnd >= lineEnd) break;
+            if (spaceDelimited) {
+                p = SkipSpaces(fieldEnd, lineEnd, '\0');
+                if (p >= lineEnd) break;
+            } else {
+                p = SkipSpaces(fieldEnd + 1, lineEnd, delimiter);
+            }
+        }
+        return fields;
+    }
+
+    // 最初の行から区切り文字を決める
+    char DetectDelimiter(const char* line, const char* lineEnd)
+    {
+        const char candidates[] = { ',', '\t', ';' };
+        char best = ' ';
+        size_t bestCount = 0;
+        for (char c : candidates) {
+            size_t count = CountByte(line, lineEnd, c);
+            if (count > bestCount) {
+                best = c;
+                bestCount = count;
+            }
+        }
+        return best;
+    }
+
+    // 行の読み方
+    struct CsvFormat {
+        char delimiter;
+        // 2 列以上あれば true（1 列目が x、2 列目が y）
+        bool hasX;
+    };
+
+    // 改行の直後から始まる範囲を読んだ結果
+    struct CsvChunk {
+        // 読み込む範囲
+        const char* begin;
+        const char* end;
+        // 結果を書き込む位置と、書き込んだ行の数
+        size_t offset;
+        size_t rows;
+        size_t skippedRows;
+    };
+
+    // chunk の行を読んで、x と y の offset の位置から書き込む
+    void ParseChunk(const CsvFormat& format, CsvChunk& chunk, double* x, double* y)
+    {
+        size_t row = chunk.offset;
+        const char* p = chunk.begin;
+
+        while (p < chunk.end) {
+            const char* lineEnd = FindByte(p, chunk.end, '\n');
+            double values[2];
+            int fields = ParseLine(p, lineEnd, format.delimiter, values);
+            p = lineEnd + 1;
+
+            if (fields == 0) continue;
+
+            if (format.hasX) {
+                if (std::isnan(values[0])) {
+                    chunk.skippedRows++;
+                    continue;
+                }
+                x[row] = values[0];
+                y[row] = fields >= 2 ? values[1] : NaN;
+            } else {
+                y[row] = values[0];
+            }
+            row++;
+        }
+
+        chunk.rows = row - chunk.offset;
+    }
+
+    // chunks をそれぞれ別のスレッドで body に渡す（最後の 1 つはこのスレッドで）
+    template<class Body>
+    void ForEachChunkInParallel(std::vector<CsvChunk>& chunks, Body body)
+    {
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i + 1 < chunks.size(); i++) {
+            threads.emplace_back([&body, &chunks, i]() { body(chunks[i]); });
+        }
+        body(chunks.back());
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
+}
+
+const char* ParseNumber(const char* begin, const char* end, double& value)
+{
+    const char* p = begin;
+
+    // 符号は正負が入り混じることが多いので、分岐せずに読み飛ばす
+    bool negative = p < end && *p == '-';
+    p += p < end && (*p == '+' || *p == '-');
+
+    // 仮数を 10 進の整数として読み、小数点の位置は 10 の指数にする
+    // 桁ごとに分岐しないように、20 桁以上で uint64_t があふれても読み続けて、後で strtod に任せる
+    uint64_t mantissa = 0;
+    int exponent = 0;
+
+    const char* integerBegin = p;
+    for (; p < end && IsDigit(*p); p++) {
+        mantissa = mantissa * 10 + (*p - '0');
+    }
+    ptrdiff_t digits = p - integerBegin;
+
+    if (p < end && *p == '.') {
+        p++;
+        const char* fractionBegin = p;
+        for (; p < end && IsDigit(*p); p++) {
+            mantissa = mantissa * 10 + (*p - '0');
+        }
+        exponent = -static_cast<int>(std::min<ptrdiff_t>(p - fractionBegin, INT_MAX / 2));
+        digits += p - fractionBegin;
+    }
+
+    if (digits == 0) return begin;
+
+    // e の後に数字がなければ、e は数値の一部ではない
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '+' || *q == '-')) {
+            negativeExponent = *q == '-';
+            q++;
+        }
+        if (q < end && IsDigit(*q)) {
+            int e = 0;
+            for (; q < end && IsDigit(*q); q++) {
+                if (e < 100000) e = e * 10 + (*q - '0');
+            }
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+
+    bool fits = digits <= MaxMantissaDigits;
+    if (fits && mantissa == 0) {
+        value = negative ? -0.0 : 0.0;
+        return p;
+    }
+
+    if (fits && mantissa <= MaxExactMantissa && exponent >= -MaxExactPower && exponent <= MaxExactPower) {
+        double m = static_cast<double>(mantissa);
+        double result = exponent < 0 ? m / ExactPowersOf10[-exponent] : m * ExactPowersOf10[exponent];
+        value = negative ? -result : result;
+        return p;
+    }
+
+    // 桁の多い数値や指数の大きい数値は strtod で正しく丸める
+    std::string token(begin, p);
+    value = std::strtod(token.c_str(), nullptr);
+    return p;
+}
+
+int ParseCsvLine(const char* line, const char* lineEnd, double values[2])
+{
+    return ParseLine(line, lineEnd, DetectDelimiter(line, lineEnd), values);
+}
+
+bool ParseCsv(const char* text, size_t size, CsvData& result, std::string& error)
+{
+    const char* end = text + size;
+    const char* p = text;
+
+    // UTF-8 の BOM を飛ばす
+    if (size >= 3 && std::memcmp(p, "\xEF\xBB\xBF", 3) == 0) p += 3;
+
+    // 最初の空でない行で区切り文字と列の数を決め、数値でなければ見出しとして飛ばす
+    CsvFormat format = { ',', false };
+    const char* dataBegin = end;
+    for (int header = 0; p < end; ) {
+        const char* lineEnd = FindByte(p, end, '\n');
+        format.delimiter = DetectDelimiter(p, lineEnd);
+        double values[2];
+        int fields = ParseLine(p, lineEnd, format.delimiter, values);
+
+        if (fields > 0 && (!std::isnan(values[0]) || header > 0)) {
+            format.hasX = fields >= 2;
+            dataBegin = p;
+            break;
+        }
+        if (fields > 0) header++;
+        p = lineEnd + 1;
+    }
+
+    if (dataBegin >= end) {
+        error = "no numeric rows";
+        return false;
+    }
+
+    // 改行の直後で区切って、スレッドごとに読む範囲を決める
+    size_t dataSize = end - dataBegin;
+    size_t threadCount = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    size_t chunkCount = std::min(threadCount, std::max<size_t>(dataSize / MinChunkBytes, 1));
+
+    std::vector<CsvChunk> chunks(chunkCount);
+    const char* chunkBegin = dataBegin;
+    for (size_t i = 0; i < chunkCount; i++) {
+        const char* chunkEnd = end;
+        if (i + 1 < chunkCount) {
+            chunkEnd = FindByte(std::max(chunkBegin, dataBegin + dataSize * (i + 1) / chunkCount), end, '\n');
+            if (chunkEnd < end) chunkEnd++;
+        }
+        chunks[i] = CsvChunk{ chunkBegin, chunkEnd, 0, 0, 0 };
+        chunkBegin = chunkEnd;
+    }
+
+    // 行の数は改行の数 + 1 以下なので、それだけ確保して各範囲の書き込み位置を決める
+    std::vector<size_t> lineCounts(chunkCount);
+    ForEachChunkInParallel(chunks, [&](CsvChunk& chunk) {
+        lineCounts[&chunk - chunks.data()] = CountByte(chunk.begin, chunk.end, '\n') + 1;
+    });
+
+    size_t capacity = 0;
+    for (size_t i = 0; i < chunkCount; i++) {
+        chunks[i].offset = capacity;
+        capacity += lineCounts[i];
+    }
+
+    result.x.resize(format.hasX ? capacity : 0);
+    result.y.resize(capacity);
+    double* x = result.x.data();
+    double* y = result.y.data();
+    ForEachChunkInParallel(chunks, [&](CsvChunk& chunk) {
+        ParseChunk(format, chunk, x, y);
+    });
+
+    // 空の行や飛ばした行の分だけ空いたところを詰める
+    size_t rows = 0;
+    result.skippedRows = 0;
+    for (const CsvChunk& chunk : chunks) {
+        if (chunk.offset != rows) {
+            if (format.hasX) std::copy_n(x + chunk.offset, chunk.rows, x + rows);
+            std::copy_n(y + chunk.offset, chunk.rows, y + rows);
+        }
+        rows += chunk.rows;
+        result.skippedRows += chunk.skippedRows;
+    }
+    result.x.resize(rows);
+    result.y.resize(rows);
+
+    if (!format.hasX) {
+        for (size_t i = 0; i < rows; i++) {
+            result.x[i] = static_cast<double>(i);
+        }
+    }
+
+    if (rows == 0) {
+        error = "no numeric rows";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,34 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// CSV（TSV など）を読んだ結果
+struct CsvData {
+    std::vector<double> x;
+    std::vector<double> y;
+    // x が数値として読めずに飛ばした行の数（見出しの行と空の行は含まない）
+    size_t skippedRows;
+};
+
+// text（size バイト）を CSV として読む
+// 区切り文字はカンマ、タブ、セミコロン、空白のどれでもよく、最初の行でいちばん多いものにする
+// 1 列目を x、2 列目を y とする（1 列しかなければ行番号を x にする）
+// 1 行目の 1 列目が数値でなければ見出しとして飛ばす
+// 読めない y は NaN（値の欠け）にする
+//
+// 大きなテキストは改行の直後で区切ってスレッドごとに読む
+// 先に改行を数えて各スレッドが書き込む位置を決めておくので、結果をつなぎ合わせるためのコピーはいらない
+bool ParseCsv(const char* text, size_t size, CsvData& result, std::string& error);
+
+// 1 行（改行は含まない）を読んで、先頭から最大 2 列の値を values に入れる
+// 区切り文字は ParseCsv と同じ決め方で、行ごとに決める（少しずつ届くデータを読むときに使う）
+// 数値でない列は NaN にする
+// 戻り値は列の数（空の行なら 0）
+int ParseCsvLine(const char* line, const char* lineEnd, double values[2]);
+
+// begin から数値を 1 つ読んで、読み終わった位置を返す（読めなければ begin を返す）
+// 有効桁が 19 桁以下で 10 の指数が小さい数値は、strtod を呼ばずに
+// 仮数と 10 の累乗（どちらも double でちょうど表せる）の掛け算か割り算 1 回で正しく丸めた値を求める
+const char* ParseNumber(const char* begin, const char* end, double& value);
@@ -0,0 +1,178 @@
+﻿#include "DataCache.h"
+
+// C++ ライブラリ
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+// GraphViewer
+#include "MappedFile.h"
+
+namespace {
+    const char CacheMagic[8] = { 'G', 'V', 'C', 'A', 'C', 'H', 'E', '\0' };
+    const uint32_t CacheVersion = 2;
+
+    // 1 回の WriteFile で書く最大のバイト数
+    const size_t MaxWriteBytes = 64 << 20;
+
+    // ファイルの末尾に置く目次
+    struct CacheFooter {
+        char magic[8];
+        uint32_t version;
+        uint32_t levelCount;
+        uint64_t rowCount;
+        uint64_t sourceSize;
+        uint64_t sourceWriteTime;
+        // ファイルの先頭からの位置（dataSize は圧縮した列のバイト数）
+        uint64_t dataOffset;
+        uint64_t dataSize;
+        uint64_t blockOffset;
+        uint64_t levelOffset;
+    };
+
+    std::wstring CachePath(LPCWSTR sourcePath)
+    {
+        return std::wstring(sourcePath) + L".gvcache";
+    }
+
+    // offset から count 個の T が、ファイルの目次より前に収まっているか
+    template<class T>
+    bool FitsBefore(uint64_t offset, uint64_t count, uint64_t limit)
+    {
+        return offset % sizeof(double) == 0 && offset <= limit && count <= (limit - offset) / sizeof(T);
+    }
+
+    // 列のあとを 8 バイト境界まで埋めるバイトの数
+    size_t PaddingOf(size_t size)
+    {
+        return (sizeof(double) - size % sizeof(double)) % sizeof(double);
+    }
+
+    HRESULT WriteAll(HANDLE file, const void* data, size_t size)
+    {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            DWORD chunk = static_cast<DWORD>(std::min(size, MaxWriteBytes));
+            DWORD written;
+            if (!WriteFile(file, p, chunk, &written, nullptr)) return HRESULT_FROM_WIN32(GetLastError());
+            p += written;
+            size -= written;
+        }
+        return S_OK;
+    }
+}
+
+HRESULT GetSourceStamp(LPCWSTR path, SourceStamp& stamp)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExW(path, GetFileExInfoStandard, &attributes)) return HRESULT_FROM_WIN32(GetLastError());
+
+    stamp.size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+    stamp.writeTime = (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+    return S_OK;
+}
+
+HRESULT OpenDataCache(LPCWSTR sourcePath, SampledData& data)
+{
+    SourceStamp stamp;
+    HRESULT hr = GetSourceStamp(sourcePath, stamp);
+    if (FAILED(hr)) return hr;
+
+    // 段とブロックは必要なところだけ読まれるので、先読みはしない
+    auto file = std::make_shared<MappedFile>();
+    hr = file->Open(CachePath(sourcePath).c_str(), false);
+    if (FAILED(hr)) return hr;
+
+    if (file->Size() < sizeof(CacheFooter)) return E_FAIL;
+    uint64_t limit = file->Size() - sizeof(CacheFooter);
+    CacheFooter footer;
+    std::memcpy(&footer, file->Data() + limit, sizeof(footer));
+
+    // 形式が違うか、元のファイルが変わっていれば使わない
+    if (std::memcmp(footer.magic, CacheMagic, sizeof(CacheMagic)) != 0 || footer.version != CacheVersion) return E_FAIL;
+    if (footer.sourceSize != stamp.size || footer.sourceWriteTime != stamp.writeTime) return E_FAIL;
+    if (footer.rowCount == 0 || footer.rowCount > SIZE_MAX / sizeof(double)) return E_FAIL;
+
+    size_t rows = static_cast<size_t>(footer.rowCount);
+    uint64_t seriesBlocks = (rows + SeriesBlockSize - 1) / SeriesBlockSize;
+    std::vector<size_t> counts = SummaryLevelCounts(rows, SeriesBlockSize);
+    uint64_t levelBlocks = std::accumulate(counts.begin(), counts.end(), uint64_t(0));
+    if (footer.levelCount != counts.size()
+        || !FitsBefore<char>(footer.dataOffset, footer.dataSize, limit)
+        || !FitsBefore<SeriesBlock>(footer.blockOffset, seriesBlocks, limit)
+        || !FitsBefore<MinMax>(footer.levelOffset, levelBlocks, limit))
+    {
+        return E_FAIL;
+    }
+
+    const char* base = file->Data();
+    auto series = std::make_shared<CompressedSeries>(
+        file,
+        reinterpret_cast<const SeriesBlock*>(base + footer.blockOffset),
+        reinterpret_cast<const uint8_t*>(base + footer.dataOffset),
+        static_cast<size_t>(footer.dataSize),
+        rows
+    );
+    data = SampledData(series, MakeSummaryLevels(reinterpret_cast<const MinMax*>(base + footer.levelOffset), counts, SeriesBlockSize));
+    return S_OK;
+}
+
+HRESULT WriteDataCache(LPCWSTR sourcePath, const SampledData& data)
+{
+    SourceStamp stamp;
+    HRESULT hr = GetSourceStamp(sourcePath, stamp);
+    if (FAILED(hr)) return hr;
+
+    std::wstring path = CachePath(sourcePath);
+    std::wstring temporaryPath = path + L".tmp";
+
+    HANDLE file = CreateFileW(temporaryPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return HRESULT_FROM_WIN32(GetLastError());
+
+    size_t rows = data.Size();
+
+    // 段 0 は圧縮したブロックごとの範囲にして、上の段はそこから作る
+    std::vector<uint8_t> compressed;
+    std::vector<SeriesBlock> seriesBlocks;
+    CompressSeries(data.X(), data.Y(), rows, compressed, seriesBlocks);
+
+    std::vector<size_t> counts = SummaryLevelCounts(rows, SeriesBlockSize);
+    std::vector<MinMax> levelBlocks(std::accumulate(counts.begin(), counts.end(), size_t(0)));
+    if (!counts.empty()) {
+        for (size_t i = 0; i < counts[0]; i++) {
+            levelBlocks[i] = seriesBlocks[i].range;
+        }
+        BuildUpperSummaryLevels(counts, levelBlocks.data());
+    }
+
+    const char padding[sizeof(double)] = {};
+    size_t paddingSize = PaddingOf(compressed.size());
+
+    CacheFooter footer = {};
+    std::memcpy(footer.magic, CacheMagic, sizeof(CacheMagic));
+    footer.version = CacheVersion;
+    footer.levelCount = static_cast<uint32_t>(counts.size());
+    footer.rowCount = rows;
+    footer.sourceSize = stamp.size;
+    footer.sourceWriteTime = stamp.writeTime;
+    footer.dataOffset = 0;
+    footer.dataSize = compressed.size();
+    footer.blockOffset = footer.dataOffset + compressed.size() + paddingSize;
+    footer.levelOffset = footer.blockOffset + seriesBlocks.size() * sizeof(SeriesBlock);
+
+    hr = WriteAll(file, compressed.data(), compressed.size());
+    if (SUCCEEDED(hr)) hr = WriteAll(file, padding, paddingSize);
+    if (SUCCEEDED(hr)) hr = WriteAll(file, seriesBlocks.data(), seriesBlocks.size() * sizeof(SeriesBlock));
+    if (SUCCEEDED(hr)) hr = WriteAll(file, levelBlocks.data(), levelBlocks.size() * sizeof(MinMax));
+    if (SUCCEEDED(hr)) hr = WriteAll(file, &footer, sizeof(footer));
+    CloseHandle(file);
+
+    if (SUCCEEDED(hr) && !MoveFileExW(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    if (FAILED(hr)) DeleteFileW(temporaryPath.c_str());
+    return hr;
+}
@@ -0,0 +1,33 @@
+﻿#pragma once
+
+#include <cstdint>
+
+#include <Windows.h>
+
+#include "SampledData.h"
+
+// 取り込んだデータのキャッシュファイル
+// 元のファイルの隣に「元のファイル名.gvcache」として置き、次に開くときは CSV を読み直さずにマップして使う
+//
+// 形式（数値はすべてリトルエンディアン）
+//   圧縮した x, y の列（CompressSeries で SeriesBlockSize 点ずつ圧縮したブロックを続けたもの、8 バイト境界まで 0 で埋める）
+//   ブロックの目次（SeriesBlock × ブロックの数）
+//   y の最小値・最大値の段（段 0 を SeriesBlockSize 点ごとにして、SummaryLevelCounts の順に MinMax を並べたもの）
+//   CacheFooter（ファイルの末尾、それぞれの位置と、元のファイルの大きさと更新日時）
+// 目次と段は固定長で 8 バイト境界に並ぶので、マップしたまま配列として読める
+// 全体を表示するときは段と目次だけを読み、拡大したときは見えているブロックだけを読んで展開する
+
+// 元のファイルが変わっていないかを確かめるための情報
+struct SourceStamp {
+    uint64_t size;
+    uint64_t writeTime;
+};
+
+HRESULT GetSourceStamp(LPCWSTR path, SourceStamp& stamp);
+
+// sourcePath のキャッシュがあって、元のファイルから変わっていなければ、マップして data にする
+HRESULT OpenDataCache(LPCWSTR sourcePath, SampledData& data);
+
+// data を sourcePath のキャッシュとして書く（data は配列の列を持っていること）
+// 一時ファイルに書いてから置き換えるので、途中で失敗しても壊れたキャッシュは残らない
+HRESULT WriteDataCache(LPCWSTR sourcePath, const SampledData& data);
@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// DataSource::Query の結果
+// 列 i は x[i] から次の列の x（最後の列は問い合わせた範囲の右端）までで、その中の値の範囲が min[i]..max[i]
+// 範囲の中の点が少なければ点をそのまま 1 列ずつ返す（min == max）
+// 値が全部欠けている列は NaN、点が 1 つもない列は入れない
+struct DataSpan {
+    std::vector<double> x;
+    std::vector<double> min;
+    std::vector<double> max;
+
+    size_t Size() const { return x.size(); }
+
+    void Clear()
+    {
+        x.clear();
+        min.clear();
+        max.clear();
+    }
+
+    void Resize(size_t count)
+    {
+        x.resize(count);
+        min.resize(count);
+        max.resize(count);
+    }
+
+    void Push(double columnX, double columnMin, double columnMax)
+    {
+        x.push_back(columnX);
+        min.push_back(columnMin);
+        max.push_back(columnMax);
+    }
+};
+
+// グラフに描くデータの出どころ
+// 表示範囲（Viewport）は持たず、聞かれた x の範囲を画面の列の数程度にまとめて答える
+// 索引を持つデータは索引から答えるので、描く手間は範囲の中の点の数によらず画面の幅に比例する
+class DataSource {
+public:
+    virtual ~DataSource() {}
+
+    // xmin < x <= xmax の範囲を desiredPoints 列以下にまとめて span に入れる
+    // desiredPoints は細かさの目安で、ふつうは画面の列の数を渡す
+    virtual void Query(double xmin, double xmax, int desiredPoints, DataSpan& span) const = 0;
+
+    // x0 から dx 刻みの count 列を描くときに読むデータを先に読んでおく
+    // 描画スレッドとは別のスレッドから呼ばれる
+    virtual void Prefetch(double x0, double dx, int count) const = 0;
+
+    // データが変わるたびに増える番号（変わらないデータは 0 のまま）
+    // 変わったら、描いたものや計算した値は使えない
+    // どのスレッドから呼んでもよい
+    virtual uint64_t Revision() const = 0;
+};
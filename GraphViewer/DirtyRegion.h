@@ -0,0 +1,123 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// 画面上の列の範囲 [left, right)
+struct ColumnSpan {
+    int left;
+    int right;
+};
+
+// 描き直しが必要な列をまとめておく
+// グラフはタイルも含めて縦いっぱいの短冊で扱っているので、x 方向の範囲だけ覚えておけば足りる
+// 範囲は固定の大きさの配列に持つので、フレームごとにコピーしてもヒープから確保しない
+class DirtyRegion {
+public:
+    // 範囲の数の上限。超えたら間が一番狭いものどうしをつなげる
+    static const size_t MaxSpans = 8;
+
+    DirtyRegion()
+        : m_all(false),
+        m_count(0)
+    {
+    }
+
+    // [left, right) を含む列を追加する
+    void Add(float left, float right)
+    {
+        if (m_all) return;
+
+        ColumnSpan span = {
+            static_cast<int>(std::floor(left)),
+            static_cast<int>(std::ceil(right))
+        };
+        if (span.left >= span.right) return;
+
+        // 重なるか隣り合うものはまとめる
+        size_t kept = 0;
+        for (size_t i = 0; i < m_count; i++) {
+            if (m_spans[i].right >= span.left && span.right >= m_spans[i].left) {
+                span.left = std::min(span.left, m_spans[i].left);
+                span.right = std::max(span.right, m_spans[i].right);
+            } else {
+                m_spans[kept++] = m_spans[i];
+            }
+        }
+        m_count = kept;
+
+        ColumnSpan* pos = std::lower_bound(m_spans, m_spans + m_count, span,
+            [](const ColumnSpan& a, const ColumnSpan& b) { return a.left < b.left; });
+        std::copy_backward(pos, m_spans + m_count, m_spans + m_count + 1);
+        *pos = span;
+        m_count++;
+
+        if (m_count > MaxSpans) {
+            MergeClosest();
+        }
+    }
+
+    // 全体を描き直す
+    void AddAll()
+    {
+        m_all = true;
+        m_count = 0;
+    }
+
+    void Merge(const DirtyRegion& other)
+    {
+        if (other.m_all) {
+            AddAll();
+            return;
+        }
+        for (size_t i = 0; i < other.m_count; i++) {
+            Add(static_cast<float>(other.m_spans[i].left), static_cast<float>(other.m_spans[i].right));
+        }
+    }
+
+    void Clear()
+    {
+        m_all = false;
+        m_count = 0;
+    }
+
+    bool IsEmpty() const { return !m_all && m_count == 0; }
+    bool IsAll() const { return m_all; }
+
+    // 幅 width の画面に収まるように切り詰めた範囲を spans に入れて、その数を返す
+    // spans には MaxSpans 個入るようにしておく
+    int Spans(int width, ColumnSpan* spans) const
+    {
+        int count = 0;
+        if (m_all) {
+            if (width > 0) spans[count++] = ColumnSpan{ 0, width };
+            return count;
+        }
+
+        for (size_t i = 0; i < m_count; i++) {
+            ColumnSpan clipped = { std::max(m_spans[i].left, 0), std::min(m_spans[i].right, width) };
+            if (clipped.left < clipped.right) spans[count++] = clipped;
+        }
+        return count;
+    }
+
+private:
+    void MergeClosest()
+    {
+        size_t best = 0;
+        for (size_t i = 1; i + 1 < m_count; i++) {
+            if (m_spans[i + 1].left - m_spans[i].right < m_spans[best + 1].left - m_spans[best].right) {
+                best = i;
+            }
+        }
+        m_spans[best].right = m_spans[best + 1].right;
+        std::copy(m_spans + best + 2, m_spans + m_count, m_spans + best + 1);
+        m_count--;
+    }
+
+    bool m_all;
+    // left の昇順で、重なりはない（1 つ足してから MergeClosest でつなげるので、1 つ余分に持てるようにする）
+    ColumnSpan m_spans[MaxSpans + 1];
+    size_t m_count;
+};
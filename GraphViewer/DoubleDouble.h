@@ -0,0 +1,150 @@
+﻿#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// double 2 つの和 hi + lo で表す、double の約 2 倍の精度の数
+// 深くズームして隣の点の x が double では同じ値になってしまうときに、x をこの型で評価する
+// hi は hi + lo を double に丸めた値になるように保つので、結果を double にするときは hi を使えばよい
+struct DoubleDouble {
+    double hi;
+    double lo;
+
+    DoubleDouble() : hi(0), lo(0) {}
+    DoubleDouble(double value) : hi(value), lo(0) {}
+    DoubleDouble(double hi, double lo) : hi(hi), lo(lo) {}
+};
+
+namespace DoubleDoubleDetail {
+    // |a| >= |b| のとき、a + b を丸めた値と丸め誤差の組にする
+    // 値が無限大や NaN なら誤差は 0 とする（inf - inf で NaN が広がらないように）
+    inline DoubleDouble QuickTwoSum(double a, double b)
+    {
+        double s = a + b;
+        if (!std::isfinite(s)) return DoubleDouble(s, 0);
+        return DoubleDouble(s, b - (s - a));
+    }
+
+    // a + b を丸めた値と丸め誤差の組にする（大小によらない）
+    inline DoubleDouble TwoSum(double a, double b)
+    {
+        double s = a + b;
+        if (!std::isfinite(s)) return DoubleDouble(s, 0);
+        double v = s - a;
+        return DoubleDouble(s, (a - (s - v)) + (b - v));
+    }
+
+    // a * b を丸めた値と丸め誤差の組にする
+    inline DoubleDouble TwoProd(double a, double b)
+    {
+        double p = a * b;
+        if (!std::isfinite(p)) return DoubleDouble(p, 0);
+        return DoubleDouble(p, std::fma(a, b, -p));
+    }
+}
+
+inline DoubleDouble operator+(const DoubleDouble& a, const DoubleDouble& b)
+{
+    using namespace DoubleDoubleDetail;
+    DoubleDouble s = TwoSum(a.hi, b.hi);
+    DoubleDouble t = TwoSum(a.lo, b.lo);
+    s = QuickTwoSum(s.hi, s.lo + t.hi);
+    return QuickTwoSum(s.hi, s.lo + t.lo);
+}
+
+inline DoubleDouble operator-(const DoubleDouble& a)
+{
+    return DoubleDouble(-a.hi, -a.lo);
+}
+
+inline DoubleDouble operator-(const DoubleDouble& a, const DoubleDouble& b)
+{
+    return a + -b;
+}
+
+inline DoubleDouble operator*(const DoubleDouble& a, const DoubleDouble& b)
+{
+    using namespace DoubleDoubleDetail;
+    DoubleDouble p = TwoProd(a.hi, b.hi);
+    return QuickTwoSum(p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));
+}
+
+// 商を double で 3 回求めて、そのたびに余りで補正する
+inline DoubleDouble operator/(const DoubleDouble& a, const DoubleDouble& b)
+{
+    using namespace DoubleDoubleDetail;
+    double q1 = a.hi / b.hi;
+    if (!std::isfinite(q1)) return DoubleDouble(q1, 0);
+    DoubleDouble r = a - b * q1;
+    double q2 = r.hi / b.hi;
+    r = r - b * q2;
+    double q3 = r.hi / b.hi;
+    return QuickTwoSum(q1, q2) + q3;
+}
+
+inline bool operator<(const DoubleDouble& a, const DoubleDouble& b)
+{
+    return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+inline bool operator>(const DoubleDouble& a, const DoubleDouble& b)
+{
+    return b < a;
+}
+
+inline DoubleDouble Select(bool condition, const DoubleDouble& ifTrue, const DoubleDouble& ifFalse)
+{
+    return condition ? ifTrue : ifFalse;
+}
+
+// 以下、f(hi + lo) = f(hi) + f'(hi) * lo として計算する
+// lo は hi の 1ulp 未満なので 2 次の項は double の丸め誤差より小さい
+// f(hi) の丸め誤差は残るが、隣の点との差（深くズームしたときに見たい変化）は lo の分まで正しく出る
+
+inline DoubleDouble exp(const DoubleDouble& x)
+{
+    double e = std::exp(x.hi);
+    return DoubleDoubleDetail::QuickTwoSum(e, e * x.lo);
+}
+
+inline DoubleDouble log(const DoubleDouble& x)
+{
+    return DoubleDoubleDetail::QuickTwoSum(std::log(x.hi), x.lo / x.hi);
+}
+
+inline DoubleDouble sqrt(const DoubleDouble& x)
+{
+    double s = std::sqrt(x.hi);
+    return DoubleDoubleDetail::QuickTwoSum(s, x.lo / (2 * s));
+}
+
+inline DoubleDouble sin(const DoubleDouble& x)
+{
+    return DoubleDoubleDetail::QuickTwoSum(std::sin(x.hi), std::cos(x.hi) * x.lo);
+}
+
+inline DoubleDouble cos(const DoubleDouble& x)
+{
+    return DoubleDoubleDetail::QuickTwoSum(std::cos(x.hi), -std::sin(x.hi) * x.lo);
+}
+
+inline DoubleDouble fabs(const DoubleDouble& x)
+{
+    return x.hi < 0 ? -x : x;
+}
+
+// 整数を丸めずに DoubleDouble にする（2^53 を超える px 座標も正確に表す）
+// |value| が 2^62 以下なら hi も int64_t に戻せるので、丸めた分の差が正確に求まる
+inline DoubleDouble MakeDoubleDouble(int64_t value)
+{
+    double hi = static_cast<double>(value);
+    int64_t rest = value - static_cast<int64_t>(hi);
+    return DoubleDoubleDetail::QuickTwoSum(hi, static_cast<double>(rest));
+}
+
+// 最も近い整数に丸める（int64_t に収まる範囲で）
+inline int64_t RoundToInt64(const DoubleDouble& x)
+{
+    double whole = std::round(x.hi);
+    return static_cast<int64_t>(whole) + std::llround((x.hi - whole) + x.lo);
+}
@@ -0,0 +1,120 @@
+﻿#pragma once
+
+#include <cmath>
+#include <type_traits>
+
+#include "FastMath.h"
+
+// 値と微分係数の組（前進型の自動微分）
+// x を BasicDual(x, 1) として式を評価すると、値と一緒に dy/dx が得られる
+// T は値を計算する型（double か FastDouble）
+template<class T>
+struct BasicDual {
+    T value;
+    T derivative;
+
+    BasicDual() : value(0), derivative(0) {}
+    BasicDual(T value, T derivative) : value(value), derivative(derivative) {}
+
+    // 定数（微分係数は 0）
+    // 1 - exp(t) のように整数と混ぜて書けるように、T に変換できる型ならそのまま受け取る
+    template<class U, class = typename std::enable_if<std::is_convertible<U, T>::value>::type>
+    BasicDual(U value) : value(T(value)), derivative(0) {}
+
+    friend BasicDual operator+(const BasicDual& a, const BasicDual& b)
+    {
+        return BasicDual(a.value + b.value, a.derivative + b.derivative);
+    }
+
+    friend BasicDual operator-(const BasicDual& a, const BasicDual& b)
+    {
+        return BasicDual(a.value - b.value, a.derivative - b.derivative);
+    }
+
+    friend BasicDual operator*(const BasicDual& a, const BasicDual& b)
+    {
+        return BasicDual(a.value * b.value, a.derivative * b.value + a.value * b.derivative);
+    }
+
+    friend BasicDual operator/(const BasicDual& a, const BasicDual& b)
+    {
+        T q = a.value / b.value;
+        return BasicDual(q, (a.derivative - q * b.derivative) / b.value);
+    }
+
+    friend BasicDual operator-(const BasicDual& a)
+    {
+        return BasicDual(-a.value, -a.derivative);
+    }
+
+    friend bool operator<(const BasicDual& a, const BasicDual& b) { return a.value < b.value; }
+    friend bool operator>(const BasicDual& a, const BasicDual& b) { return a.value > b.value; }
+
+    friend BasicDual Select(bool condition, const BasicDual& ifTrue, const BasicDual& ifFalse)
+    {
+        return condition ? ifTrue : ifFalse;
+    }
+};
+
+// 標準の関数で計算する
+using Dual = BasicDual<double>;
+// exp などを近似関数で計算する
+using FastDual = BasicDual<FastDouble>;
+
+template<class T>
+BasicDual<T> exp(const BasicDual<T>& x)
+{
+    using std::exp;
+    T e = exp(x.value);
+    return BasicDual<T>(e, e * x.derivative);
+}
+
+template<class T>
+BasicDual<T> log(const BasicDual<T>& x)
+{
+    using std::log;
+    return BasicDual<T>(log(x.value), x.derivative / x.value);
+}
+
+template<class T>
+BasicDual<T> sqrt(const BasicDual<T>& x)
+{
+    using std::sqrt;
+    T s = sqrt(x.value);
+    return BasicDual<T>(s, x.derivative / (T(2) * s));
+}
+
+template<class T>
+BasicDual<T> sin(const BasicDual<T>& x)
+{
+    using std::sin;
+    using std::cos;
+    return BasicDual<T>(sin(x.value), cos(x.value) * x.derivative);
+}
+
+template<class T>
+BasicDual<T> cos(const BasicDual<T>& x)
+{
+    using std::sin;
+    using std::cos;
+    return BasicDual<T>(cos(x.value), -sin(x.value) * x.derivative);
+}
+
+template<class T>
+BasicDual<T> fabs(const BasicDual<T>& x)
+{
+    return x.value < T(0) ? -x : x;
+}
+
+namespace DualDetail {
+    inline double ToDouble(double value) { return value; }
+    inline double ToDouble(FastDouble value) { return value.value; }
+}
+
+// 評価した結果から値と傾きを取り出す
+template<class T>
+void SplitDual(const BasicDual<T>& y, double& value, double& slope)
+{
+    value = DualDetail::ToDouble(y.value);
+    slope = DualDetail::ToDouble(y.derivative);
+}
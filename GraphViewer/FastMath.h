@@ -0,0 +1,220 @@
+﻿#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+// 画面に描くだけなら十分な精度の、速い超越関数
+// 誤差の上限は Sampler.h の FastMathMaxError で、exp と log は相対誤差、sin と cos は絶対誤差で測る
+//
+// FastMathDetail の ExpKernel などは、引数を範囲に収めてから多項式で計算し、範囲の外の点は NaN に置き換える
+// 標準の関数を呼ばず、選ぶのも計算済みの値どうしなので、点のループの中で分岐がなくベクトル化できる
+// FastExp などは配列をまとめて計算し、範囲の外の点があったときだけ、その点を標準の関数で計算し直す
+// FastDouble の exp などは ExpKernel などをそのまま使うので、範囲の外の点は NaN になる
+// 点ごとのループの後で、有限でない点だけを double で計算し直す（Sampler.h の RecomputeNonFinite）
+
+// sin・cos の引数の範囲の簡約で誤差が増えない範囲（外は標準の関数で計算する）
+const double FastMathMaxTrigArgument = 1e4;
+
+namespace FastMathDetail {
+    // 足して引くと最も近い整数に丸められる数（1.5 * 2^52）
+    // floor と違って SSE2 だけでベクトル化でき、足した結果の下位ビットはそのまま整数として使える
+    const double RoundingShifter = 6755399441055744.0;
+
+    inline double FromBits(int64_t bits)
+    {
+        double d;
+        std::memcpy(&d, &bits, sizeof(d));
+        return d;
+    }
+
+    inline int64_t ToBits(double d)
+    {
+        int64_t bits;
+        std::memcpy(&bits, &d, sizeof(bits));
+        return bits;
+    }
+
+    // condition ? ifTrue : ifFalse を、マスクを使ったビット演算で選ぶ
+    // 浮動小数点の ?: は、選ばれない側の計算を省こうとして分岐に戻されることがあり、そうなるとベクトル化されない
+    inline double Blend(bool condition, double ifTrue, double ifFalse)
+    {
+        int64_t mask = -static_cast<int64_t>(condition);
+        return FromBits((ToBits(ifTrue) & mask) | (ToBits(ifFalse) & ~mask));
+    }
+
+    // x を lo 以上 hi 以下に収める（NaN はそのまま）
+    inline double Clamp(double x, double lo, double hi)
+    {
+        return Blend(x < lo, lo, Blend(x > hi, hi, x));
+    }
+
+    // 多項式で近似できる引数の範囲（NaN は範囲の外）
+    // exp は 2^k が正規化数で表せる範囲、log は正の正規化数、sin・cos は FastMathMaxTrigArgument まで
+    // && だと分岐になってベクトル化できないので、& でつなぐ
+    inline bool ExpInRange(double x) { return (x >= -708.0) & (x <= 709.0); }
+    inline bool LogInRange(double x) { return (x >= 2.2250738585072014e-308) & (x <= 1.7976931348623157e308); }
+    inline bool TrigInRange(double x) { return (x >= -FastMathMaxTrigArgument) & (x <= FastMathMaxTrigArgument); }
+
+    // |r| <= π/4 での sin と cos
+    inline double SinPolynomial(double r)
+    {
+        double r2 = r * r;
+        return r * (1 + r2 * (-1.0 / 6 + r2 * (1.0 / 120 + r2 * (-1.0 / 5040 + r2 * (1.0 / 362880)))));
+    }
+
+    inline double CosPolynomial(double r)
+    {
+        double r2 = r * r;
+        return 1 + r2 * (-1.0 / 2 + r2 * (1.0 / 24 + r2 * (-1.0 / 720 + r2 * (1.0 / 40320 + r2 * (-1.0 / 3628800)))));
+    }
+
+    // e^x = 2^k * e^r（|r| <= ln2 / 2）として、e^r を 6 次の多項式で求める
+    // 相対誤差は 2e-7 以下（ExpInRange の外は NaN）
+    inline double ExpKernel(double x)
+    {
+        const double log2e = 1.4426950408889634;
+        const double ln2Hi = 6.93147180369123816490e-01;
+        const double ln2Lo = 1.90821492927058770002e-10;
+
+        // 2^k が正規化数で表せる範囲に収める（NaN はそのまま残るが、結果は下で捨てる）
+        double clamped = Clamp(x, -708.0, 709.0);
+
+        double shifted = clamped * log2e + RoundingShifter;
+        double k = shifted - RoundingShifter;
+        int64_t exponent = ToBits(shifted) - ToBits(RoundingShifter);
+
+        double r = clamped - k * ln2Hi - k * ln2Lo;
+        double p = 1 + r * (1 + r * (1.0 / 2 + r * (1.0 / 6 + r * (1.0 / 24 + r * (1.0 / 120 + r * (1.0 / 720))))));
+        // NaN のときの exponent はでたらめなので、符号なしでずらす
+        double scale = FromBits(static_cast<int64_t>(static_cast<uint64_t>(exponent + 1023) << 52));
+
+        return Blend(ExpInRange(x), p * scale, std::numeric_limits<double>::quiet_NaN());
+    }
+
+    // x = m * 2^e（√½ <= m < √2）として、log m = 2 atanh((m - 1) / (m + 1)) を級数で求める
+    // 相対誤差は 2e-9 以下（LogInRange の外は NaN）
+    inline double LogKernel(double x)
+    {
+        const double ln2 = 0.69314718055994530942;
+
+        int64_t bits = ToBits(x);
+        // 仮数が √2 以上なら 1 つ上の指数にして、m を √½ 以上 √2 未満にする
+        int64_t adjust = (bits & 0x000FFFFFFFFFFFFFLL) >= 0x6A09E667F3BCDLL ? 1 : 0;
+        int64_t e = ((bits >> 52) & 0x7FF) - 1023 + adjust;
+        // int64_t から double への変換は AVX-512 までベクトル化できないので、RoundingShifter の下位ビットに入れて引く
+        double exponent = FromBits(ToBits(RoundingShifter) + e) - RoundingShifter;
+        double m = FromBits((bits & 0x000FFFFFFFFFFFFFLL) | ((1023 - adjust) << 52));
+
+        double s = (m - 1) / (m + 1);
+        double s2 = s * s;
+        double logM = 2 * s * (1 + s2 * (1.0 / 3 + s2 * (1.0 / 5 + s2 * (1.0 / 7 + s2 * (1.0 / 9)))));
+        double result = logM + exponent * ln2;
+
+        return Blend(LogInRange(x), result, std::numeric_limits<double>::quiet_NaN());
+    }
+
+    // x = kπ/2 + r（|r| <= π/4）として、k を 4 で割った余りで sin か cos の多項式を選ぶ
+    // 絶対誤差は 2e-9 以下（0 に近い値では相対誤差は大きくなる、TrigInRange の外は NaN）
+    inline double SinKernel(double x)
+    {
+        const double twoOverPi = 0.63661977236758134308;
+        const double piOver2Hi = 1.57079632673412561417e+00;
+        const double piOver2Lo = 6.07710050650619224932e-11;
+
+        // 範囲の外の大きな引数でも k が整数として取り出せるように収める（結果は下で捨てる）
+        double clamped = Clamp(x, -FastMathMaxTrigArgument, FastMathMaxTrigArgument);
+
+        double shifted = clamped * twoOverPi + RoundingShifter;
+        double k = shifted - RoundingShifter;
+        int64_t quadrant = ToBits(shifted) & 3;
+
+        double r = clamped - k * piOver2Hi - k * piOver2Lo;
+
+        double s = SinPolynomial(r);
+        double c = CosPolynomial(r);
+        double v = Blend((quadrant & 1) != 0, c, s);
+        double result = Blend((quadrant & 2) != 0, -v, v);
+        return Blend(TrigInRange(x), result, std::numeric_limits<double>::quiet_NaN());
+    }
+
+    // SinKernel(x + π/2)（絶対誤差は SinKernel と同じ）
+    inline double CosKernel(double x)
+    {
+        const double piOver2 = 1.57079632679489661923;
+        return Blend(TrigInRange(x), SinKernel(x + piOver2), std::numeric_limits<double>::quiet_NaN());
+    }
+
+    // x の count 点を kernel でまとめて y に計算し、inRange の外の点だけを exact で計算し直す
+    // 範囲の外の点があるかはループの中で OR を取るだけにして、調べるのはまとめて 1 回にする
+    template<class Kernel, class InRange, class Exact>
+    void Apply(const double* x, double* y, int count, Kernel kernel, InRange inRange, Exact exact)
+    {
+        // bool の OR はベクトル化されないので、int で数える
+        int outside = 0;
+        for (int i = 0; i < count; i++) {
+            y[i] = kernel(x[i]);
+            outside |= !inRange(x[i]);
+        }
+        if (outside == 0) return;
+
+        for (int i = 0; i < count; i++) {
+            if (!inRange(x[i])) y[i] = exact(x[i]);
+        }
+    }
+}
+
+// x の count 点の近似値を y に書き込む（計算し直す点を x で調べるので、x と y は別の配列にする）
+// 範囲の外の引数（大きすぎる値や NaN など）の点は標準の関数で計算するので、どの引数でも誤差は上限に収まる
+inline void FastExp(const double* x, double* y, int count)
+{
+    FastMathDetail::Apply(x, y, count, FastMathDetail::ExpKernel, FastMathDetail::ExpInRange, [](double v) { return std::exp(v); });
+}
+
+inline void FastLog(const double* x, double* y, int count)
+{
+    FastMathDetail::Apply(x, y, count, FastMathDetail::LogKernel, FastMathDetail::LogInRange, [](double v) { return std::log(v); });
+}
+
+inline void FastSin(const double* x, double* y, int count)
+{
+    FastMathDetail::Apply(x, y, count, FastMathDetail::SinKernel, FastMathDetail::TrigInRange, [](double v) { return std::sin(v); });
+}
+
+inline void FastCos(const double* x, double* y, int count)
+{
+    FastMathDetail::Apply(x, y, count, FastMathDetail::CosKernel, FastMathDetail::TrigInRange, [](double v) { return std::cos(v); });
+}
+
+// 近似関数で計算するための数値型
+// 式を auto で受け取るように書いておくと、この型で評価したときだけ exp などが近似版になる
+// exp などの引数が範囲の外なら結果は NaN になるので、評価した後に有限でない点を double で計算し直す
+// 近似関数の結果を比べて Select で選ぶと NaN が消えて計算し直せないので、そういう式はこの型で評価しない
+struct FastDouble {
+    double value;
+
+    FastDouble() : value(0) {}
+    FastDouble(double value) : value(value) {}
+};
+
+inline FastDouble operator+(FastDouble a, FastDouble b) { return a.value + b.value; }
+inline FastDouble operator-(FastDouble a, FastDouble b) { return a.value - b.value; }
+inline FastDouble operator*(FastDouble a, FastDouble b) { return a.value * b.value; }
+inline FastDouble operator/(FastDouble a, FastDouble b) { return a.value / b.value; }
+inline FastDouble operator-(FastDouble a) { return -a.value; }
+
+inline bool operator<(FastDouble a, FastDouble b) { return a.value < b.value; }
+inline bool operator>(FastDouble a, FastDouble b) { return a.value > b.value; }
+
+inline FastDouble exp(FastDouble x) { return FastMathDetail::ExpKernel(x.value); }
+inline FastDouble log(FastDouble x) { return FastMathDetail::LogKernel(x.value); }
+inline FastDouble sin(FastDouble x) { return FastMathDetail::SinKernel(x.value); }
+inline FastDouble cos(FastDouble x) { return FastMathDetail::CosKernel(x.value); }
+inline FastDouble sqrt(FastDouble x) { return std::sqrt(x.value); }
+inline FastDouble fabs(FastDouble x) { return std::fabs(x.value); }
+
+inline FastDouble Select(bool condition, FastDouble ifTrue, FastDouble ifFalse)
+{
+    return condition ? ifTrue : ifFalse;
+}
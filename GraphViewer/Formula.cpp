@@ -0,0 +1,478 @@
+﻿#include "Formula.h"
+
+// C++ ライブラリ
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <tuple>
+#include <utility>
+
+namespace {
+    // exp(k + p) を exp(k) * exp(p) に書き換えてよい定数 k の大きさ
+    // 大きすぎると exp(p) だけが先にあふれたり 0 になったりする
+    const double MaxExpShift = 64;
+
+    // 式の書き換えの度合い
+    enum class FormulaRewrite {
+        // 書いたとおりに 1 演算ずつ命令にする
+        None,
+        // どの x でも値が変わらない書き換えだけをする
+        Exact,
+        // 近似関数で計算するときのために、丸めが変わる書き換えもする
+        Approximate
+    };
+
+    // 命令の引数の数
+    int OperandCount(FormulaOp op)
+    {
+        switch (op) {
+        case FormulaOp::Constant:
+        case FormulaOp::Variable:
+            return 0;
+        case FormulaOp::Add:
+        case FormulaOp::Sub:
+        case FormulaOp::Mul:
+        case FormulaOp::Div:
+            return 2;
+        default:
+            return 1;
+        }
+    }
+
+    // 引数がすべて定数の命令を計算する
+    double Fold(FormulaOp op, double a, double b)
+    {
+        switch (op) {
+        case FormulaOp::Add: return a + b;
+        case FormulaOp::Sub: return a - b;
+        case FormulaOp::Mul: return a * b;
+        case FormulaOp::Div: return a / b;
+        case FormulaOp::Neg: return -a;
+        case FormulaOp::Exp: return std::exp(a);
+        case FormulaOp::Log: return std::log(a);
+        case FormulaOp::Sqrt: return std::sqrt(a);
+        case FormulaOp::Sin: return std::sin(a);
+        case FormulaOp::Cos: return std::cos(a);
+        case FormulaOp::Abs: return std::fabs(a);
+        default: return a;
+        }
+    }
+
+    // 命令列を組み立てる
+    // 同じ命令は 1 つにまとめ（共通部分式の除去）、引数がすべて定数なら計算して定数にする
+    // x に依存しない部分はすべて定数になるので、点ごとのループには x に依存する命令だけが残る
+    //
+    // 書き換えは、どの x でも書いたとおりに計算したのと同じ値になるものだけにする
+    // 結合法則や分配法則で定数をまとめたり、exp(k + p) = exp(k) * exp(p) としたりすると、
+    // 丸めが変わるうえに、あふれたり 0 になったりする x の範囲も変わる
+    // そうした書き換えは、近似関数で計算するとき（FormulaRewrite::Approximate）だけにする
+    // 定数をまとめ、k * (c + p) を k * c + k * p に直しておくと、exp(-2 * (t - 3)) が exp(6 + (-2 * t)) になり、
+    // exp(6) * exp(-2 * t) と書き換えて exp(-2 * t) と exp を共有できる
+    class FormulaBuilder {
+    public:
+        explicit FormulaBuilder(FormulaRewrite rewrite) : m_optimize(rewrite != FormulaRewrite::None), m_approximate(rewrite == FormulaRewrite::Approximate) {}
+
+        int Constant(double value)
+        {
+            return Emit(FormulaInstruction{ FormulaOp::Constant, 0, 0, value });
+        }
+
+        int Variable()
+        {
+            return Emit(FormulaInstruction{ FormulaOp::Variable, 0, 0, 0 });
+        }
+
+        int Unary(FormulaOp op, int a)
+        {
+            if (!m_optimize) return Emit(FormulaInstruction{ op, a, 0, 0 });
+            if (IsConstant(a)) return Constant(Fold(op, m_code[a].value, 0));
+
+            // m_code は命令を足すと動くので、コピーしておく
+            FormulaInstruction arg = m_code[a];
+
+            if (op == FormulaOp::Neg) {
+                // -(-p) = p
+                if (arg.op == FormulaOp::Neg) return arg.a;
+                // -(k * p) = (-k) * p
+                if (arg.op == FormulaOp::Mul && IsConstant(arg.a)) {
+                    return Binary(FormulaOp::Mul, Constant(-m_code[arg.a].value), arg.b);
+                }
+            }
+
+            if (op == FormulaOp::Exp && m_approximate) {
+                // exp(k + p) = exp(k) * exp(p)
+                if (arg.op == FormulaOp::Add && IsConstant(arg.a) && std::fabs(m_code[arg.a].value) <= MaxExpShift) {
+                    double factor = std::exp(m_code[arg.a].value);
+                    return Binary(FormulaOp::Mul, Constant(factor), Unary(FormulaOp::Exp, arg.b));
+                }
+            }
+
+            return Emit(FormulaInstruction{ op, a, 0, 0 });
+        }
+
+        int Binary(FormulaOp op, int a, int b)
+        {
+            if (!m_optimize) return Emit(FormulaInstruction{ op, a, b, 0 });
+            if (IsConstant(a) && IsConstant(b)) return Constant(Fold(op, m_code[a].value, m_code[b].value));
+
+            switch (op) {
+            case FormulaOp::Sub:
+                // p - k = (-k) + p
+                if (IsConstant(b)) return Binary(FormulaOp::Add, Constant(-m_code[b].value), a);
+                break;
+
+            case FormulaOp::Add:
+            case FormulaOp::Mul:
+            {
+                // 定数を左に寄せ、それ以外は番号順に並べて a + b と b + a を同じ命令にする
+                if (IsConstant(b) || (!IsConstant(a) && b < a)) std::swap(a, b);
+
+                FormulaInstruction right = m_code[b];
+
+                if (op == FormulaOp::Add) {
+                    // (-0) + p = p（+0 + p は p = -0 のとき +0 になるので、そのまま残す）
+                    if (IsConstant(a, 0) && std::signbit(m_code[a].value)) return b;
+
+                    // k1 + (k2 + p) = (k1 + k2) + p
+                    if (m_approximate && IsConstant(a) && right.op == FormulaOp::Add && IsConstant(right.a)) {
+                        return Binary(FormulaOp::Add, Constant(m_code[a].value + m_code[right.a].value), right.b);
+                    }
+                } else if (IsConstant(a)) {
+                    double k = m_code[a].value;
+                    if (k == 1) return b;
+                    if (k == -1) return Unary(FormulaOp::Neg, b);
+
+                    if (m_approximate) {
+                        // k1 * (k2 * p) = (k1 * k2) * p
+                        if (right.op == FormulaOp::Mul && IsConstant(right.a)) {
+                            return Binary(FormulaOp::Mul, Constant(k * m_code[right.a].value), right.b);
+                        }
+                        // k1 * (k2 + p) = k1 * k2 + k1 * p
+                        if (right.op == FormulaOp::Add && IsConstant(right.a)) {
+                            return Binary(FormulaOp::Add, Constant(k * m_code[right.a].value), Binary(FormulaOp::Mul, a, right.b));
+                        }
+                    }
+
+                    // k * (-p) = (-k) * p
+                    if (right.op == FormulaOp::Neg) {
+                        return Binary(FormulaOp::Mul, Constant(-k), right.a);
+                    }
+                }
+                break;
+            }
+
+            case FormulaOp::Div:
+            {
+                if (IsConstant(b, 1)) return a;
+
+                // p / k = (1 / k) * p
+                // k が 2 の累乗なら 1 / k はちょうど表せるので、結果は変わらない
+                if (IsConstant(b)) {
+                    int exponent;
+                    double k = m_code[b].value;
+                    double inverse = 1 / k;
+                    if (std::fabs(std::frexp(k, &exponent)) == 0.5 && std::isnormal(inverse)) {
+                        return Binary(FormulaOp::Mul, Constant(inverse), a);
+                    }
+                }
+                break;
+            }
+
+            default:
+                break;
+            }
+
+            return Emit(FormulaInstruction{ op, a, b, 0 });
+        }
+
+        // result の計算に使う命令だけを残して code に入れ、結果の入る命令の番号を返す
+        int Finish(int result, std::vector<FormulaInstruction>& code) const
+        {
+            std::vector<bool> used(m_code.size(), false);
+            used[result] = true;
+            for (int i = result; i >= 0; i--) {
+                if (!used[i]) continue;
+                int operands = OperandCount(m_code[i].op);
+                if (operands >= 1) used[m_code[i].a] = true;
+                if (operands >= 2) used[m_code[i].b] = true;
+            }
+
+            std::vector<int> renumber(m_code.size(), 0);
+            code.clear();
+            for (int i = 0; i <= result; i++) {
+                if (!used[i]) continue;
+                FormulaInstruction ins = m_code[i];
+                ins.a = renumber[ins.a];
+                ins.b = renumber[ins.b];
+                renumber[i] = static_cast<int>(code.size());
+                code.push_back(ins);
+            }
+
+            return renumber[result];
+        }
+
+    private:
+        bool IsConstant(int r) const { return m_code[r].op == FormulaOp::Constant; }
+        bool IsConstant(int r, double value) const { return IsConstant(r) && m_code[r].value == value; }
+
+        // 同じ命令がすでにあればその番号を返す
+        int Emit(const FormulaInstruction& ins)
+        {
+            if (!m_optimize) {
+                m_code.push_back(ins);
+                return static_cast<int>(m_code.size()) - 1;
+            }
+
+            uint64_t bits;
+            std::memcpy(&bits, &ins.value, sizeof(bits));
+            auto key = std::make_tuple(ins.op, ins.a, ins.b, bits);
+
+            auto found = m_index.find(key);
+            if (found != m_index.end()) return found->second;
+
+            int r = static_cast<int>(m_code.size());
+            m_code.push_back(ins);
+            m_index.emplace(key, r);
+            return r;
+        }
+
+        bool m_optimize;
+        bool m_approximate;
+        std::vector<FormulaInstruction> m_code;
+        std::map<std::tuple<FormulaOp, int, int, uint64_t>, int> m_index;
+    };
+
+    // 再帰下降で式を読んで、FormulaBuilder に命令を足していく
+    // 読めなければ -1 を返し、最初のエラーを覚えておく
+    class FormulaParser {
+    public:
+        FormulaParser(const std::string& text, FormulaBuilder& builder)
+            : m_text(text), m_pos(0), m_builder(builder)
+        {
+        }
+
+        int Parse(std::string& error)
+        {
+            int result = ParseSum();
+            SkipSpaces();
+            if (result >= 0 && m_pos < m_text.size()) {
+                result = Fail("unexpected character");
+            }
+            error = m_error;
+            return result;
+        }
+
+    private:
+        // 足し算と引き算
+        int ParseSum()
+        {
+            int left = ParseProduct();
+            while (left >= 0) {
+                FormulaOp op;
+                if (Accept('+')) op = FormulaOp::Add;
+                else if (Accept('-')) op = FormulaOp::Sub;
+                else break;
+
+                int right = ParseProduct();
+                if (right < 0) return -1;
+                left = m_builder.Binary(op, left, right);
+            }
+            return left;
+        }
+
+        // 掛け算と割り算
+        int ParseProduct()
+        {
+            int left = ParseUnary();
+            while (left >= 0) {
+                FormulaOp op;
+                if (Accept('*')) op = FormulaOp::Mul;
+                else if (Accept('/')) op = FormulaOp::Div;
+                else break;
+
+                int right = ParseUnary();
+                if (right < 0) return -1;
+                left = m_builder.Binary(op, left, right);
+            }
+            return left;
+        }
+
+        int ParseUnary()
+        {
+            if (Accept('-')) {
+                int operand = ParseUnary();
+                return operand < 0 ? -1 : m_builder.Unary(FormulaOp::Neg, operand);
+            }
+            if (Accept('+')) return ParseUnary();
+            return ParsePrimary();
+        }
+
+        // 数値、名前、関数呼び出し、括弧
+        int ParsePrimary()
+        {
+            SkipSpaces();
+            if (m_pos >= m_text.size()) return Fail("unexpected end of formula");
+
+            char c = m_text[m_pos];
+
+            if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+                const char* begin = m_text.c_str() + m_pos;
+                char* end;
+                double value = std::strtod(begin, &end);
+                if (end == begin) return Fail("invalid number");
+                m_pos += end - begin;
+                return m_builder.Constant(value);
+            }
+
+            if (std::isalpha(static_cast<unsigned char>(c))) {
+                size_t start = m_pos;
+                while (m_pos < m_text.size() && (std::isalnum(static_cast<unsigned char>(m_text[m_pos])) || m_text[m_pos] == '_')) {
+                    m_pos++;
+                }
+                std::string name = m_text.substr(start, m_pos - start);
+
+                if (name == "x" || name == "t") return m_builder.Variable();
+                if (name == "pi") return m_builder.Constant(3.14159265358979323846);
+                if (name == "e") return m_builder.Constant(2.71828182845904523536);
+
+                FormulaOp op;
+                if (name == "exp") op = FormulaOp::Exp;
+                else if (name == "log") op = FormulaOp::Log;
+                else if (name == "sqrt") op = FormulaOp::Sqrt;
+                else if (name == "sin") op = FormulaOp::Sin;
+                else if (name == "cos") op = FormulaOp::Cos;
+                else if (name == "abs") op = FormulaOp::Abs;
+                else {
+                    m_pos = start;
+                    return Fail("unknown name '" + name + "'");
+                }
+
+                if (!Accept('(')) return Fail("expected '('");
+                int argument = ParseSum();
+                if (argument < 0) return -1;
+                if (!Accept(')')) return Fail("expected ')'");
+                return m_builder.Unary(op, argument);
+            }
+
+            if (Accept('(')) {
+                int inner = ParseSum();
+                if (inner < 0) return -1;
+                if (!Accept(')')) return Fail("expected ')'");
+                return inner;
+            }
+
+            return Fail("unexpected character");
+        }
+
+        void SkipSpaces()
+        {
+            while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+                m_pos++;
+            }
+        }
+
+        // 空白の次が c なら読み進めて true を返す
+        bool Accept(char c)
+        {
+            SkipSpaces();
+            if (m_pos < m_text.size() && m_text[m_pos] == c) {
+                m_pos++;
+                return true;
+            }
+            return false;
+        }
+
+        int Fail(const std::string& message)
+        {
+            if (m_error.empty()) {
+                std::ostringstream s;
+                s << message << " at column " << (m_pos + 1);
+                m_error = s.str();
+            }
+            return -1;
+        }
+
+        const std::string& m_text;
+        size_t m_pos;
+        FormulaBuilder& m_builder;
+        std::string m_error;
+    };
+
+    // text を rewrite の書き換えで命令列にする
+    bool Compile(const std::string& text, FormulaRewrite rewrite, std::vector<FormulaInstruction>& code, int& result, std::string& error)
+    {
+        FormulaBuilder builder(rewrite);
+        FormulaParser parser(text, builder);
+
+        int root = parser.Parse(error);
+        if (root < 0) return false;
+
+        result = builder.Finish(root, code);
+        return true;
+    }
+
+    // exp, log, sin, cos, sqrt を呼ぶ命令の数
+    size_t CountTranscendental(const std::vector<FormulaInstruction>& code)
+    {
+        size_t count = 0;
+        for (const FormulaInstruction& ins : code) {
+            switch (ins.op) {
+            case FormulaOp::Exp:
+            case FormulaOp::Log:
+            case FormulaOp::Sqrt:
+            case FormulaOp::Sin:
+            case FormulaOp::Cos:
+                count++;
+                break;
+            default:
+                break;
+            }
+        }
+        return count;
+    }
+}
+
+CompiledFormula::CompiledFormula(std::vector<FormulaInstruction> code, int result)
+    : m_code(code),
+    m_result(result),
+    m_fastCode(std::move(code)),
+    m_fastResult(result),
+    m_registers(m_code.size() * FormulaRegisterBytes)
+{
+}
+
+CompiledFormula::CompiledFormula(std::vector<FormulaInstruction> code, int result, std::vector<FormulaInstruction> fastCode, int fastResult)
+    : m_code(std::move(code)),
+    m_result(result),
+    m_fastCode(std::move(fastCode)),
+    m_fastResult(fastResult),
+    m_registers(std::max(m_code.size(), m_fastCode.size()) * FormulaRegisterBytes)
+{
+}
+
+size_t CompiledFormula::TranscendentalCount() const
+{
+    return CountTranscendental(m_code);
+}
+
+size_t CompiledFormula::FastTranscendentalCount() const
+{
+    return CountTranscendental(m_fastCode);
+}
+
+bool CompileFormula(const std::string& text, CompiledFormula& result, std::string& error, bool optimize)
+{
+    std::vector<FormulaInstruction> code, fastCode;
+    int root, fastRoot;
+    if (!Compile(text, optimize ? FormulaRewrite::Exact : FormulaRewrite::None, code, root, error)
+        || !Compile(text, optimize ? FormulaRewrite::Approximate : FormulaRewrite::None, fastCode, fastRoot, error))
+    {
+        return false;
+    }
+
+    result = CompiledFormula(std::move(code), root, std::move(fastCode), fastRoot);
+    return true;
+}
@@ -0,0 +1,262 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "DoubleDouble.h"
+#include "Dual.h"
+#include "FastMath.h"
+
+// 実行時に文字列から読み込む式
+// 使える書き方: 数値, x または t（変数）, pi, e, + - * /, 括弧, exp log sqrt sin cos abs
+
+// 命令の種類
+enum class FormulaOp {
+    Constant,
+    Variable,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Neg,
+    Exp,
+    Log,
+    Sqrt,
+    Sin,
+    Cos,
+    Abs
+};
+
+// 1 命令
+// 結果は命令の番号のレジスタに入り、a, b は引数のレジスタの番号（使わない引数は 0）
+struct FormulaInstruction {
+    FormulaOp op;
+    int a;
+    int b;
+    // Constant の値
+    double value;
+};
+
+// Sample でまとめて計算する点の数
+const int FormulaBlockSize = 64;
+
+// 1 命令あたりのレジスタの大きさ（Sample で FormulaBlockSize 点分の double を持てる大きさ）
+// 1 点ずつ評価するときは、どの型の値もこれに収まる
+const size_t FormulaRegisterBytes = FormulaBlockSize * sizeof(double);
+
+// 最適化した命令列
+// 同じ部分式は 1 回だけ計算され、x に依存しない部分は定数に畳み込まれている
+// 近似関数で計算するとき（FastDouble, FastDual）は、丸めが変わる書き換えもした別の命令列を使う
+// レジスタは命令列を作ったときに確保しておき、評価のたびに使い回すのでヒープから確保しない
+// そのため、同じ CompiledFormula を複数のスレッドから同時に評価してはいけない（スレッドごとにコピーを持つ）
+class CompiledFormula {
+public:
+    CompiledFormula() : m_result(0), m_fastResult(0) {}
+    CompiledFormula(std::vector<FormulaInstruction> code, int result);
+    // fastCode は近似関数で計算するときの命令列
+    CompiledFormula(std::vector<FormulaInstruction> code, int result, std::vector<FormulaInstruction> fastCode, int fastResult);
+
+    // 命令の数
+    size_t InstructionCount() const { return m_code.size(); }
+
+    // exp, log, sin, cos, sqrt を呼ぶ命令の数（1 点あたりの超越関数の呼び出し回数）
+    size_t TranscendentalCount() const;
+
+    // 近似関数で計算するときの命令列での TranscendentalCount
+    size_t FastTranscendentalCount() const;
+
+    // T は double, Interval, FastDouble, Dual, DoubleDouble のどれでもよい
+    template<class T>
+    T operator()(T x) const
+    {
+        const std::vector<FormulaInstruction>& code = Code<T>();
+        T* registers = Registers<T>();
+        for (size_t k = 0; k < code.size(); k++) {
+            new (&registers[k]) T(Execute(code[k], x, registers));
+        }
+        return registers[Result<T>()];
+    }
+
+    // x0 から dx 刻みで count 個の点を評価して values に書き込む
+    // 命令ごとに FormulaBlockSize 点をまとめて計算するので、命令の振り分けは点ごとではなくブロックごとになる
+    // T は超越関数を計算する型（double か FastDouble か float）
+    // float のときはレジスタも float にするので、1 命令でベクトル化できる要素数が倍になる
+    template<class T = double>
+    void Sample(double x0, double dx, int count, double* values) const
+    {
+        using Register = typename std::conditional<std::is_same<T, float>::value, float, double>::type;
+        const std::vector<FormulaInstruction>& code = Code<T>();
+        Register* registers = Registers<Register, FormulaBlockSize>();
+
+        // 定数は点によらないので、ループの外で 1 回だけ埋めておく
+        for (size_t i = 0; i < code.size(); i++) {
+            if (code[i].op == FormulaOp::Constant) {
+                std::fill_n(&registers[i * FormulaBlockSize], FormulaBlockSize, static_cast<Register>(code[i].value));
+            }
+        }
+
+        for (int first = 0; first < count; first += FormulaBlockSize) {
+            int n = std::min(FormulaBlockSize, count - first);
+            for (size_t i = 0; i < code.size(); i++) {
+                ExecuteBlock<T>(code[i], x0, dx, first, n, registers, &registers[i * FormulaBlockSize]);
+            }
+            std::copy_n(&registers[Result<T>() * FormulaBlockSize], n, values + first);
+        }
+    }
+
+    // x0 から dx 刻みで count 個の点の値と傾き dy/dx を求める
+    // T は傾きを計算する型（Dual か FastDual）
+    template<class T>
+    void SampleSlope(double x0, double dx, int count, double* values, double* slopes) const
+    {
+        const std::vector<FormulaInstruction>& code = Code<T>();
+        T* registers = Registers<T>();
+        for (int i = 0; i < count; i++) {
+            T x(x0 + dx * i, 1);
+            for (size_t k = 0; k < code.size(); k++) {
+                new (&registers[k]) T(Execute(code[k], x, registers));
+            }
+            SplitDual(registers[Result<T>()], values[i], slopes[i]);
+        }
+    }
+
+    // x0 + dx * i の点を DoubleDouble で評価する（深くズームしたとき）
+    void SampleDeep(const DoubleDouble& x0, double dx, int count, double* values) const
+    {
+        DoubleDouble* registers = Registers<DoubleDouble>();
+        for (int i = 0; i < count; i++) {
+            DoubleDouble x = x0 + dx * i;
+            for (size_t k = 0; k < m_code.size(); k++) {
+                new (&registers[k]) DoubleDouble(Execute(m_code[k], x, registers));
+            }
+            values[i] = registers[m_result].hi;
+        }
+    }
+
+private:
+    // T が近似関数で計算する型か
+    template<class T>
+    static constexpr bool IsFast() { return std::is_same<T, FastDouble>::value || std::is_same<T, FastDual>::value; }
+
+    // T で計算するときの命令列と、結果の入る命令の番号
+    template<class T>
+    const std::vector<FormulaInstruction>& Code() const { return IsFast<T>() ? m_fastCode : m_code; }
+    template<class T>
+    int Result() const { return IsFast<T>() ? m_fastResult : m_result; }
+
+    // 命令ごとに PerInstruction 個の T を入れるレジスタ
+    // 命令 k のレジスタは [k * PerInstruction, (k + 1) * PerInstruction)
+    // 値はデストラクタを呼ばずに上書きするので、T はデストラクタで何もしない型に限る
+    template<class T, size_t PerInstruction = 1>
+    T* Registers() const
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "レジスタはデストラクタを呼ばない");
+        static_assert(sizeof(T) * PerInstruction <= FormulaRegisterBytes, "レジスタに収まらない");
+        static_assert(alignof(T) <= alignof(std::max_align_t), "レジスタの境界に合わない");
+        return reinterpret_cast<T*>(m_registers.data());
+    }
+
+    static float ValueOf(float value) { return value; }
+    static double ValueOf(double value) { return value; }
+
+    // 超越関数の命令 op を n 点分計算して r に書き込む
+    template<class T, class Register>
+    static void ExecuteTranscendental(FormulaOp op, T, const Register* a, int n, Register* r)
+    {
+        using std::exp;
+        using std::log;
+        using std::sin;
+        using std::cos;
+
+        switch (op) {
+        case FormulaOp::Exp: for (int j = 0; j < n; j++) r[j] = ValueOf(exp(T(a[j]))); break;
+        case FormulaOp::Log: for (int j = 0; j < n; j++) r[j] = ValueOf(log(T(a[j]))); break;
+        case FormulaOp::Sin: for (int j = 0; j < n; j++) r[j] = ValueOf(sin(T(a[j]))); break;
+        case FormulaOp::Cos: for (int j = 0; j < n; j++) r[j] = ValueOf(cos(T(a[j]))); break;
+        default: break;
+        }
+    }
+
+    // 近似関数はブロックの点をまとめて計算し、範囲の外の引数の点だけを標準の関数で計算し直す
+    static void ExecuteTranscendental(FormulaOp op, FastDouble, const double* a, int n, double* r)
+    {
+        switch (op) {
+        case FormulaOp::Exp: FastExp(a, r, n); break;
+        case FormulaOp::Log: FastLog(a, r, n); break;
+        case FormulaOp::Sin: FastSin(a, r, n); break;
+        case FormulaOp::Cos: FastCos(a, r, n); break;
+        default: break;
+        }
+    }
+
+    // 1 命令を n 点分計算して r に書き込む
+    // 命令の種類で分けてから点のループを回すので、四則演算のループはベクトル化できる
+    template<class T, class Register>
+    static void ExecuteBlock(const FormulaInstruction& ins, double x0, double dx, int first, int n, const Register* registers, Register* r)
+    {
+        const Register* a = registers + ins.a * FormulaBlockSize;
+        const Register* b = registers + ins.b * FormulaBlockSize;
+
+        switch (ins.op) {
+        case FormulaOp::Constant: break;
+        case FormulaOp::Variable: for (int j = 0; j < n; j++) r[j] = static_cast<Register>(x0 + dx * (first + j)); break;
+        case FormulaOp::Add: for (int j = 0; j < n; j++) r[j] = a[j] + b[j]; break;
+        case FormulaOp::Sub: for (int j = 0; j < n; j++) r[j] = a[j] - b[j]; break;
+        case FormulaOp::Mul: for (int j = 0; j < n; j++) r[j] = a[j] * b[j]; break;
+        case FormulaOp::Div: for (int j = 0; j < n; j++) r[j] = a[j] / b[j]; break;
+        case FormulaOp::Neg: for (int j = 0; j < n; j++) r[j] = -a[j]; break;
+        case FormulaOp::Exp:
+        case FormulaOp::Log:
+        case FormulaOp::Sin:
+        case FormulaOp::Cos: ExecuteTranscendental(ins.op, T(), a, n, r); break;
+        case FormulaOp::Sqrt: for (int j = 0; j < n; j++) r[j] = std::sqrt(a[j]); break;
+        case FormulaOp::Abs: for (int j = 0; j < n; j++) r[j] = std::fabs(a[j]); break;
+        }
+    }
+
+    template<class T>
+    static T Execute(const FormulaInstruction& ins, T x, const T* r)
+    {
+        using std::exp;
+        using std::log;
+        using std::sqrt;
+        using std::sin;
+        using std::cos;
+        using std::fabs;
+
+        switch (ins.op) {
+        case FormulaOp::Constant: return T(ins.value);
+        case FormulaOp::Variable: return x;
+        case FormulaOp::Add: return r[ins.a] + r[ins.b];
+        case FormulaOp::Sub: return r[ins.a] - r[ins.b];
+        case FormulaOp::Mul: return r[ins.a] * r[ins.b];
+        case FormulaOp::Div: return r[ins.a] / r[ins.b];
+        case FormulaOp::Neg: return -r[ins.a];
+        case FormulaOp::Exp: return exp(r[ins.a]);
+        case FormulaOp::Log: return log(r[ins.a]);
+        case FormulaOp::Sqrt: return sqrt(r[ins.a]);
+        case FormulaOp::Sin: return sin(r[ins.a]);
+        case FormulaOp::Cos: return cos(r[ins.a]);
+        case FormulaOp::Abs: return fabs(r[ins.a]);
+        }
+        return x;
+    }
+
+    std::vector<FormulaInstruction> m_code;
+    int m_result;
+    std::vector<FormulaInstruction> m_fastCode;
+    int m_fastResult;
+    // 長いほうの命令列の命令の数 × FormulaRegisterBytes バイト（コピーすると別に確保するので、コピーどうしは同時に評価してよい）
+    mutable std::vector<unsigned char> m_registers;
+};
+
+// text を読んで最適化した命令列を result に入れる
+// 読めなければ false を返し、error に理由を入れる
+// 近似関数で計算するときの命令列は、exp(k + p) = exp(k) * exp(p) などの丸めが変わる書き換えもして超越関数を減らす
+// optimize が false なら最適化せずに書いたとおりの命令列にする（最適化しても値が変わらないことを確かめるため）
+bool CompileFormula(const std::string& text, CompiledFormula& result, std::string& error, bool optimize = true);
@@ -0,0 +1,119 @@
+﻿#include "FrameArena.h"
+
+// C++ ライブラリ
+#include <cstdint>
+#include <new>
+
+namespace {
+    // 最初のブロックの大きさの下限
+    const size_t MinBlockBytes = 64 * 1024;
+
+    size_t AlignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+}
+
+// ブロックの先頭に置く管理情報（切り出すメモリはこの直後から）
+struct FrameArena::Block {
+    Block* previous;
+    size_t size;
+    size_t used;
+
+    char* Data() { return reinterpret_cast<char*>(this + 1); }
+};
+
+FrameArena::FrameArena()
+    : m_current(nullptr),
+    m_peakBytes(0),
+    m_heapAllocations(0)
+{
+}
+
+FrameArena::~FrameArena()
+{
+    Rewind(Marker{ nullptr, 0 });
+}
+
+void FrameArena::Reset()
+{
+    // ブロックが 1 つなら、そのまま使い直す
+    if (m_current != nullptr && m_current->previous == nullptr && m_current->size >= m_peakBytes) {
+        m_current->used = 0;
+        m_peakBytes = m_current->size;
+        return;
+    }
+
+    size_t bytes = m_peakBytes;
+    Rewind(Marker{ nullptr, 0 });
+    m_peakBytes = 0;
+    if (bytes > 0) AddBlock(bytes);
+}
+
+void FrameArena::Reserve(size_t bytes)
+{
+    if (Capacity() >= bytes) return;
+
+    // 使いかけのブロックは Rewind で戻されるまで残しておき、次の Reset でまとめる
+    AddBlock(bytes);
+}
+
+void* FrameArena::Allocate(size_t bytes, size_t alignment)
+{
+    for (;;) {
+        if (m_current != nullptr) {
+            uintptr_t base = reinterpret_cast<uintptr_t>(m_current->Data());
+            size_t offset = AlignUp(base + m_current->used, alignment) - base;
+            if (offset + bytes <= m_current->size) {
+                m_current->used = offset + bytes;
+                return m_current->Data() + offset;
+            }
+        }
+
+        // 足りなければ、今のブロックの倍以上の大きさのブロックを足す
+        size_t size = m_current != nullptr ? m_current->size * 2 : MinBlockBytes;
+        AddBlock(size > bytes + alignment ? size : bytes + alignment);
+    }
+}
+
+FrameArena::Marker FrameArena::Mark() const
+{
+    return Marker{ m_current, m_current != nullptr ? m_current->used : 0 };
+}
+
+void FrameArena::Rewind(const Marker& marker)
+{
+    while (m_current != nullptr && m_current != marker.block) {
+        Block* previous = m_current->previous;
+        ::operator delete(m_current);
+        m_current = previous;
+    }
+
+    if (m_current != nullptr) {
+        m_current->used = marker.used;
+    }
+}
+
+size_t FrameArena::Capacity() const
+{
+    size_t bytes = 0;
+    for (Block* block = m_current; block != nullptr; block = block->previous) {
+        bytes += block->size;
+    }
+    return bytes;
+}
+
+void FrameArena::AddBlock(size_t bytes)
+{
+    bytes = bytes > MinBlockBytes ? bytes : MinBlockBytes;
+
+    Block* block = static_cast<Block*>(::operator new(sizeof(Block) + bytes));
+    block->previous = m_current;
+    block->size = bytes;
+    block->used = 0;
+    m_current = block;
+    m_heapAllocations++;
+
+    size_t capacity = Capacity();
+    if (capacity > m_peakBytes) m_peakBytes = capacity;
+}
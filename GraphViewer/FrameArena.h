@@ -0,0 +1,130 @@
+﻿#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+
+// 1 フレームの間だけ使うメモリを切り出すアリーナ
+// 確保は位置をずらすだけで、返すのはフレームの始めに Reset でまとめて行う
+// 足りなくなったらブロックを足し、次の Reset で合計の大きさの 1 ブロックにまとめ直すので、
+// 同じような描画が続けばヒープから確保するのは最初のフレームだけになる
+class FrameArena {
+public:
+    // 確保した位置（Rewind で戻す）
+    struct Marker {
+        void* block;
+        size_t used;
+    };
+
+    // Scope を抜けるときに、作ったときの位置まで戻す
+    class Scope {
+    public:
+        explicit Scope(FrameArena& arena) : m_arena(arena), m_marker(arena.Mark()) {}
+        ~Scope() { m_arena.Rewind(m_marker); }
+
+    private:
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        FrameArena& m_arena;
+        Marker m_marker;
+    };
+
+    FrameArena();
+    ~FrameArena();
+
+    // 確保したものをすべて返す
+    // このフレームでブロックを足していたら、1 ブロックにまとめ直す
+    void Reset();
+
+    // 1 フレームで bytes 使えるようにしておく（足りなければここで確保する）
+    // Reset の直後に呼ぶ
+    void Reserve(size_t bytes);
+
+    // alignment（2 の累乗）にそろえた bytes バイトを切り出す
+    void* Allocate(size_t bytes, size_t alignment);
+
+    // T の配列を切り出す（初期化はしない）
+    // デストラクタは呼ばないので、T はデストラクタで何もしない型に限る
+    // SIMD でまとめて読み書きできるように、少なくとも 32 バイト境界にそろえる
+    template<class T>
+    T* AllocateArray(size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "FrameArena はデストラクタを呼ばない");
+        const size_t alignment = alignof(T) > 32 ? alignof(T) : 32;
+        return static_cast<T*>(Allocate(sizeof(T) * count, alignment));
+    }
+
+    Marker Mark() const;
+
+    // marker を取ったあとに確保したものを返す
+    void Rewind(const Marker& marker);
+
+    // ヒープからブロックを確保した回数（累計）
+    long long HeapAllocations() const { return m_heapAllocations; }
+
+    // 確保してあるブロックの大きさの合計
+    size_t Capacity() const;
+
+private:
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    struct Block;
+
+    // 少なくとも bytes 使えるブロックを足す
+    void AddBlock(size_t bytes);
+
+    // 新しいものほど先頭の、ブロックのリスト
+    Block* m_current;
+    // このフレームで同時に持っていたブロックの大きさの合計の最大
+    size_t m_peakBytes;
+    long long m_heapAllocations;
+};
+
+// FrameArena から切り出した、容量が決まった配列
+// 容量は作るときに最大の要素数を見積もって決めるので、増やすことはない
+template<class T>
+class FrameBuffer {
+public:
+    FrameBuffer() : m_data(nullptr), m_size(0), m_capacity(0) {}
+
+    FrameBuffer(FrameArena& arena, size_t capacity)
+        : m_data(arena.AllocateArray<T>(capacity)),
+        m_size(0),
+        m_capacity(capacity)
+    {
+    }
+
+    T* Data() { return m_data; }
+    const T* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+    size_t Capacity() const { return m_capacity; }
+    bool IsEmpty() const { return m_size == 0; }
+
+    T& operator[](size_t i) { return m_data[i]; }
+    const T& operator[](size_t i) const { return m_data[i]; }
+
+    T& Back() { return m_data[m_size - 1]; }
+    const T& Back() const { return m_data[m_size - 1]; }
+
+    void Clear() { m_size = 0; }
+
+    void Push(const T& value)
+    {
+        assert(m_size < m_capacity);
+        m_data[m_size++] = value;
+    }
+
+    // 要素数を size にする（増えた分は初期化しない）
+    void Resize(size_t size)
+    {
+        assert(size <= m_capacity);
+        m_size = size;
+    }
+
+private:
+    T* m_data;
+    size_t m_size;
+    size_t m_capacity;
+};
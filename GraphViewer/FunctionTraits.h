@@ -0,0 +1,39 @@
+﻿#pragma once
+
+#include <type_traits>
+#include <utility>
+
+// F が T を受け取って T を返せるか
+// 式を auto で書いておけば、double 以外の型（区間や近似計算用の型）でも評価できる
+template<class F, class T, class = void>
+struct SupportsArgument : std::false_type {};
+
+template<class F, class T>
+struct SupportsArgument<F, T, typename std::enable_if<
+    std::is_convertible<decltype(std::declval<const F&>()(std::declval<T>())), T>::value
+>::type> : std::true_type {};
+
+// Fs がすべて T を受け取って T を返せるか
+template<class T, class... Fs>
+struct AllSupportArgument : std::true_type {};
+
+template<class T, class First, class... Rest>
+struct AllSupportArgument<T, First, Rest...> : std::integral_constant<bool,
+    SupportsArgument<First, T>::value && AllSupportArgument<T, Rest...>::value> {};
+
+// F が T を受け取ってちょうど T を返すか
+// 途中で double に広げて計算する式は float で評価しても速くならないので、float で評価するかはこちらで決める
+template<class F, class T, class = void>
+struct ReturnsArgument : std::false_type {};
+
+template<class F, class T>
+struct ReturnsArgument<F, T, typename std::enable_if<
+    std::is_same<typename std::decay<decltype(std::declval<const F&>()(std::declval<T>()))>::type, T>::value
+>::type> : std::true_type {};
+
+template<class T, class... Fs>
+struct AllReturnArgument : std::true_type {};
+
+template<class T, class First, class... Rest>
+struct AllReturnArgument<T, First, Rest...> : std::integral_constant<bool,
+    ReturnsArgument<First, T>::value && AllReturnArgument<T, Rest...>::value> {};
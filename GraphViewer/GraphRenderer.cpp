@@ -0,0 +1,421 @@
+﻿#include "GraphRenderer.h"
+
+// C++ ライブラリ
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "MinMax.h"
+
+namespace {
+    // 背景色（白）
+    const GraphColor BackgroundColor = { 1.0f, 1.0f, 1.0f, 1.0f };
+    // グラフの線の色（赤）
+    const GraphColor GraphLineColor = { 1.0f, 0.0f, 0.0f, 1.0f };
+    // グラフの線の太さ
+    const float GraphLineWidth = 2.0f;
+    // カーソルの縦線の色（灰色）
+    const GraphColor CursorLineColor = { 0.5f, 0.5f, 0.5f, 1.0f };
+    // カーソルの位置の値につける印の大きさ
+    const float CursorMarkerRadius = 4.0f;
+    // 区間で評価するとき、値の範囲がこれ以下なら 1 点とみなす（px）
+    const double EnvelopeTolerancePixels = 0.5;
+    // float や近似関数で計算したときに許す誤差（px）
+    const double ApproximationTolerancePixels = 0.5;
+    // 傾きと一緒に計算する点の間隔（px）
+    const int AdaptiveKnotSpacing = 8;
+    // 点の間を直線で結んだときに許す、曲線からのずれ（px）
+    const double AdaptiveTolerancePixels = 0.25;
+    // 隣の点との差がこれより大きければ、値が飛んでいないか調べる（px）
+    const float DiscontinuityJumpPixels = 16.0f;
+    // 差がこれ以下まで縮めば、つながっているとみなす（px）
+    const float ContinuityPixels = 1.0f;
+    // 1 か所を調べるときに二分する回数
+    // 滑らかな関数なら差が半分ずつ縮むので、この回数の後に元の差の半分より大きく残っていれば飛んでいる
+    // 途中で元の差の 1/4 以下まで縮めば、その時点でつながっているとみなす
+    const int DiscontinuityBisectionSteps = 10;
+    // 1 回の描画で、値が飛んでいるかを調べるために評価する点の数の上限
+    const int DiscontinuityEvaluationBudget = 256;
+    // 画面の上下のどれだけ外で線を切り取るか（px）
+    // 境界に沿った線分や、角の継ぎ目（マイター）が画面に入らないように、線の太さより十分大きくする
+    const float ClipMarginPixels = 16.0f;
+
+    // count 列を描くときに m_points に入る点の数の上限
+    // 区間で評価したときは 1 列に 2 点、傾きから細かくしたときは最後の点が AdaptiveKnotSpacing px まではみ出す
+    size_t PointCapacity(int count)
+    {
+        return 2 * static_cast<size_t>(count) + 2 * AdaptiveKnotSpacing;
+    }
+
+    // m_stroke の上限
+    // 値が飛んでいるところでは、点ごとに飛ぶ直前と直後の点が足される
+    size_t StrokeCapacity(int count)
+    {
+        return 3 * PointCapacity(count) + 1;
+    }
+
+    // count 列を描くときに AllocateBuffers と ClipPolyline が切り出すバイト数
+    // 配列ごとに境界にそろえる分を足しておく
+    size_t FrameBytes(int count)
+    {
+        const size_t padding = 32;
+        const size_t pointPadding = PointAlignment;
+        size_t n = static_cast<size_t>(count);
+        size_t bytes = 0;
+        bytes += (n * sizeof(double) + padding) * 3;                            // m_values, m_slopes, m_refined
+        bytes += n * sizeof(Interval) + padding;                                // m_envelope
+        bytes += (PointCapacity(count) * sizeof(float) + pointPadding) * 2;     // m_points
+        bytes += (StrokeCapacity(count) * sizeof(float) + pointPadding) * 2;    // m_stroke
+        bytes += (2 * StrokeCapacity(count) * sizeof(float) + pointPadding) * 2; // m_clipped
+        bytes += StrokeCapacity(count) + padding;                               // ClipPolyline の分類
+        return bytes;
+    }
+
+    // 値の最大の大きさ
+    double Magnitude(const double* values, int count)
+    {
+        MinMax range = ComputeMinMax(values, count);
+        return range.IsEmpty() ? 0 : std::max(std::fabs(range.min), std::fabs(range.max));
+    }
+
+    // 値の誤差が valueError あっても、画面上では 1px に満たないか
+    bool IsSubPixel(const ViewportTransform& transform, double valueError)
+    {
+        return valueError * std::fabs(transform.scaleY) < ApproximationTolerancePixels;
+    }
+}
+
+GraphRenderer::GraphRenderer(std::unique_ptr<GraphSampler> sampler)
+    : m_sampler(std::move(sampler)),
+    m_precision(EvaluationPrecision::Exact),
+    m_stats(),
+    m_arenaAllocations(0)
+{
+}
+
+void GraphRenderer::BeginFrame(float width)
+{
+    m_arena.Reset();
+    m_arena.Reserve(FrameBytes(static_cast<int>(std::ceil(width)) + 3));
+    CountArenaAllocations();
+}
+
+void GraphRenderer::Render(GraphCanvas& canvas, const ViewportTransform& transform, float width, float height)
+{
+    {
+        FrameArena::Scope scope(m_arena);
+        RenderGraph(canvas, transform, width, height);
+    }
+    CountArenaAllocations();
+}
+
+void GraphRenderer::CountArenaAllocations()
+{
+    m_stats.arenaBlockAllocations += m_arena.HeapAllocations() - m_arenaAllocations;
+    m_stats.arenaBytes = static_cast<long long>(m_arena.Capacity());
+    m_arenaAllocations = m_arena.HeapAllocations();
+}
+
+void GraphRenderer::AllocateBuffers(int count)
+{
+    m_values = FrameBuffer<double>(m_arena, count);
+    m_slopes = FrameBuffer<double>(m_arena, count);
+    m_refined = FrameBuffer<double>(m_arena, count);
+    m_envelope = FrameBuffer<Interval>(m_arena, count);
+    m_points = PointBuffer(m_arena, PointCapacity(count));
+    m_stroke = PointBuffer(m_arena, StrokeCapacity(count));
+    m_clipped = PointBuffer(m_arena, 2 * StrokeCapacity(count));
+}
+
+void GraphRenderer::RenderGraph(GraphCanvas& canvas, const ViewportTransform& transform, float width, float height)
+{
+    canvas.Clear(BackgroundColor);
+
+    int maxX = static_cast<int>(std::ceil(width));
+    if (maxX <= 0) return;
+
+    // x = -1 から maxX + 1 まで 1px ごとに計算する
+    const int firstX = -1;
+    int count = maxX + 3;
+    AllocateBuffers(count);
+
+    // double では隣の列の x を区別できないほど深くズームしているなら、区間や自動微分（どちらも double で計算する）は使わずに
+    // 1px ごとに DoubleDouble で計算する
+    bool deep = !CanSampleDouble(transform.ToDomainX(firstX), transform.ToDomainX(firstX + count), transform.scaleX);
+
+    // 区間で評価できるなら、列ごとの値の範囲を縦線にして描く
+    // 近似関数で速く描くときは使わない
+    m_envelope.Resize(count);
+    double tolerance = EnvelopeTolerancePixels / std::fabs(transform.scaleY);
+    if (!deep && m_precision == EvaluationPrecision::Exact && m_sampler->SampleEnvelope(transform.ToDomainX(firstX), transform.scaleX, count, tolerance, m_envelope.Data())) {
+        m_points.Clear();
+        m_stats.samples += count;
+
+        for (int i = 0; i < count; i++) {
+            float x = static_cast<float>(firstX + i);
+            float top = transform.ToScreenY(m_envelope[i].hi);
+            float bottom = transform.ToScreenY(m_envelope[i].lo);
+
+            // 極のように値の範囲が無限に広がる列は、縦線にせず列の左端の 1 点で表す
+            // 値が飛んでいるかどうかは DrawGraphLine で調べる
+            if (!std::isfinite(top) || !std::isfinite(bottom)) {
+                m_stats.nonFinite++;
+                m_points.Push(GraphPoint{ x, transform.ToScreenY(SampleAt(transform, x)) });
+                continue;
+            }
+
+            if (bottom - top < 1.0f) {
+                m_points.Push(GraphPoint{ x, (top + bottom) / 2 });
+            } else if (!m_points.IsEmpty() && m_points.Back().y < (top + bottom) / 2) {
+                // 前の点に近い端から縦線を引く
+                m_points.Push(GraphPoint{ x, top });
+                m_points.Push(GraphPoint{ x, bottom });
+            } else {
+                m_points.Push(GraphPoint{ x, bottom });
+                m_points.Push(GraphPoint{ x, top });
+            }
+        }
+
+        DrawGraphLine(canvas, transform, height);
+        return;
+    }
+
+    // 傾きを計算できるなら、曲がっているところだけ細かく計算する
+    if (!deep && SampleAdaptive(transform, firstX, count, m_precision)) {
+        DrawGraphLine(canvas, transform, height);
+        return;
+    }
+
+    // 1px ごとの関数の値をまとめて計算して、画面上の y 座標に変換する
+    // 点の y の配列に直接書き込むので、詰め直さずにそのまま描ける
+    m_values.Resize(count);
+    SamplePoints(transform, firstX, 1, count, m_values.Data(), m_precision);
+    m_stats.samples += count;
+    m_stats.nonFinite += CountNonFinite(m_values.Data(), count);
+    m_points.Resize(count);
+    transform.ToScreenY(m_values.Data(), count, m_points.Y());
+
+    float* xs = m_points.X();
+    for (int i = 0; i < count; i++) {
+        xs[i] = static_cast<float>(firstX + i);
+    }
+
+    DrawGraphLine(canvas, transform, height);
+}
+
+void GraphRenderer::SamplePoints(const ViewportTransform& transform, double firstX, double step, int count, double* values, EvaluationPrecision precision)
+{
+    double x0 = transform.ToDomainX(firstX);
+    double dx = transform.scaleX * step;
+    double lastX = transform.ToDomainX(firstX + step * count);
+
+    // 左端の x を丸めずに持っておき、そこからのずれとして計算する
+    // DoubleDouble で評価できない関数は double のまま計算する（隣の点が同じ値になり、線は階段状になる）
+    if (!CanSampleDouble(x0, lastX, transform.scaleX)
+        && m_sampler->SampleDeep(transform.ToDomainXDeep(firstX), dx, count, values))
+    {
+        return;
+    }
+
+    // float で足りるなら、ベクトル化したときに倍の点を一度に計算できる
+    // float の誤差も近似関数の誤差も値の大きさで決まるので、計算した値の大きさで画面上の誤差を見積もる
+    if (CanSampleSingle(x0, lastX, transform.scaleX)
+        && m_sampler->SampleSingle(x0, dx, count, values)
+        && IsSubPixel(transform, SingleMaxRelativeError * Magnitude(values, count)))
+    {
+        return;
+    }
+
+    if (precision == EvaluationPrecision::Fast
+        && m_sampler->SampleFast(x0, dx, count, values)
+        && IsSubPixel(transform, FastMathValueError(Magnitude(values, count))))
+    {
+        return;
+    }
+
+    m_sampler->Sample(x0, dx, count, values);
+}
+
+double GraphRenderer::SampleAt(const ViewportTransform& transform, double x) const
+{
+    double value;
+    double domainX = transform.ToDomainX(x);
+    if (CanSampleDouble(domainX, domainX, transform.scaleX)
+        || !m_sampler->SampleDeep(transform.ToDomainXDeep(x), transform.scaleX, 1, &value))
+    {
+        m_sampler->Sample(domainX, transform.scaleX, 1, &value);
+    }
+    return value;
+}
+
+bool GraphRenderer::SampleAdaptive(const ViewportTransform& transform, int firstX, int count, EvaluationPrecision precision)
+{
+    // firstX から AdaptiveKnotSpacing px ごとに値と傾きを計算する（最後の点は count をはみ出してもよい）
+    int knots = (count - 1 + AdaptiveKnotSpacing - 1) / AdaptiveKnotSpacing + 1;
+    m_values.Resize(knots);
+    m_slopes.Resize(knots);
+    if (!m_sampler->SampleSlope(precision, transform.ToDomainX(firstX), transform.scaleX * AdaptiveKnotSpacing, knots, m_values.Data(), m_slopes.Data())) {
+        return false;
+    }
+
+    // 傾きを画面上の px あたりの y の変化にする
+    const double slopeScale = transform.scaleX * transform.scaleY;
+    const double h = AdaptiveKnotSpacing;
+    double magnitude = 0;
+    int sampled = knots;
+    int nonFinite = CountNonFinite(m_values.Data(), knots);
+
+    m_points.Clear();
+    for (int k = 0; k < knots; k++) {
+        float x = static_cast<float>(firstX + k * AdaptiveKnotSpacing);
+        m_points.Push(GraphPoint{ x, transform.ToScreenY(m_values[k]) });
+        if (std::isfinite(m_values[k])) magnitude = std::max(magnitude, std::fabs(m_values[k]));
+        if (k == knots - 1) break;
+
+        // 両端の値と傾きを通る 3 次曲線は、両端を結ぶ直線から最大で
+        // h / 4 * max(|d0 - s|, |d1 - s|) ずれる（s は直線の傾き）
+        // 細かく n 等分すると 1 区間のずれは 1 / n^2 になるので、許せるずれに収まる n を選ぶ
+        double y0 = m_values[k] * transform.scaleY;
+        double y1 = m_values[k + 1] * transform.scaleY;
+        double s = (y1 - y0) / h;
+        double d0 = m_slopes[k] * slopeScale;
+        double d1 = m_slopes[k + 1] * slopeScale;
+        double deviation = h / 4 * std::max(std::fabs(d0 - s), std::fabs(d1 - s));
+
+        // 傾きが NaN や無限大になるところは 1px ごとに計算する
+        int n = AdaptiveKnotSpacing;
+        if (deviation <= AdaptiveTolerancePixels) {
+            n = 1;
+        } else if (deviation < AdaptiveTolerancePixels * AdaptiveKnotSpacing * AdaptiveKnotSpacing) {
+            n = static_cast<int>(std::ceil(std::sqrt(deviation / AdaptiveTolerancePixels)));
+        }
+        if (n == 1) continue;
+
+        // 区間の中の n - 1 点は値だけあればよい
+        double step = h / n;
+        m_refined.Resize(n - 1);
+        SamplePoints(transform, x + step, step, n - 1, m_refined.Data(), precision);
+        sampled += n - 1;
+        nonFinite += CountNonFinite(m_refined.Data(), n - 1);
+
+        for (int i = 0; i < n - 1; i++) {
+            m_points.Push(GraphPoint{ static_cast<float>(x + step * (i + 1)), transform.ToScreenY(m_refined[i]) });
+            if (std::isfinite(m_refined[i])) magnitude = std::max(magnitude, std::fabs(m_refined[i]));
+        }
+    }
+
+    // 近似関数の誤差が 1px に近くなるほど大きな値なら、標準の関数で計算し直す
+    if (precision == EvaluationPrecision::Fast && !IsSubPixel(transform, FastMathValueError(magnitude))) {
+        return SampleAdaptive(transform, firstX, count, EvaluationPrecision::Exact);
+    }
+
+    m_stats.samples += sampled;
+    m_stats.nonFinite += nonFinite;
+    return true;
+}
+
+void GraphRenderer::DrawGraphLine(GraphCanvas& canvas, const ViewportTransform& transform, float height)
+{
+    const float top = -ClipMarginPixels;
+    const float bottom = height + ClipMarginPixels;
+    int budget = DiscontinuityEvaluationBudget;
+
+    // 値が飛んでいるところまでを 1 本の折れ線としてまとめて描く
+    auto flush = [&]() {
+        ClipPolyline(m_stroke.X(), m_stroke.Y(), static_cast<int>(m_stroke.Size()), top, bottom, m_arena, m_clipped);
+        if (m_clipped.Size() >= 2) {
+            canvas.DrawPolyline(m_clipped.X(), m_clipped.Y(), static_cast<int>(m_clipped.Size()), GraphLineColor, GraphLineWidth);
+        }
+        m_stroke.Clear();
+    };
+
+    const float* xs = m_points.X();
+    const float* ys = m_points.Y();
+    m_stroke.Clear();
+    for (size_t i = 0; i < m_points.Size(); i++) {
+        // データが欠けている点は描かずに、そこで線を切る
+        if (std::isnan(ys[i])) {
+            if (!m_stroke.IsEmpty()) m_stats.gaps++;
+            flush();
+            continue;
+        }
+
+        // 同じ列の縦線（区間で評価したとき）は値の範囲そのものなので調べない
+        // 両端が画面の同じ側に外れていれば、結んでも見えないので調べない
+        if (i > 0 && !std::isnan(ys[i - 1]) && xs[i] > xs[i - 1]
+            && !(std::fabs(ys[i] - ys[i - 1]) <= DiscontinuityJumpPixels)
+            && !(ys[i] < 0 && ys[i - 1] < 0)
+            && !(ys[i] > height && ys[i - 1] > height))
+        {
+            GraphPoint left, right;
+            if (FindDiscontinuity(transform, m_points[i - 1], m_points[i], budget, left, right)) {
+                m_stroke.Push(left);
+                flush();
+                m_stroke.Push(right);
+            }
+        }
+        m_stroke.Push(xs[i], ys[i]);
+    }
+    flush();
+}
+
+bool GraphRenderer::FindDiscontinuity(const ViewportTransform& transform, GraphPoint a, GraphPoint b, int& budget, GraphPoint& left, GraphPoint& right) const
+{
+    const float initialJump = std::fabs(b.y - a.y);
+    float jump = initialJump;
+
+    for (int step = 0; step < DiscontinuityBisectionSteps; step++) {
+        float mid = a.x + (b.x - a.x) / 2;
+        if (!(a.x < mid && mid < b.x)) break;
+
+        if (budget <= 0) return false;
+        budget--;
+
+        GraphPoint m = { mid, transform.ToScreenY(SampleAt(transform, mid)) };
+
+        // 値が求まらない点があれば、そこで切る
+        if (std::isnan(m.y)) {
+            left = a;
+            right = b;
+            return true;
+        }
+
+        // 差が大きいほうの半分に絞る
+        if (std::fabs(m.y - a.y) >= std::fabs(b.y - m.y)) {
+            b = m;
+        } else {
+            a = m;
+        }
+
+        jump = std::fabs(b.y - a.y);
+        if (jump <= ContinuityPixels || (std::isfinite(initialJump) && jump <= initialJump / 4)) return false;
+    }
+
+    // 極の上の点は無限大になるので、そのときは差が無限大のまま残るかで決める
+    bool jumping = std::isinf(initialJump) ? std::isinf(jump) : jump > initialJump / 2;
+    if (!jumping) return false;
+
+    left = a;
+    right = b;
+    return true;
+}
+
+void GraphRenderer::RenderCursor(GraphCanvas& canvas, const ViewportTransform& transform, float cursorX, float height)
+{
+    // 1px の線がぼやけないように px の中心に合わせる
+    float x = std::floor(cursorX) + 0.5f;
+
+    float lineX[] = { x, x };
+    float lineY[] = { 0.0f, height };
+    canvas.DrawPolyline(lineX, lineY, 2, CursorLineColor, 1.0f);
+
+    float y = transform.ToScreenY(SampleAt(transform, x));
+
+    // 値がないところや画面の外には印をつけない
+    if (!(y >= -CursorMarkerRadius && y <= height + CursorMarkerRadius)) return;
+
+    const float r = CursorMarkerRadius;
+    float markerX[] = { x - r, x, x + r, x, x - r };
+    float markerY[] = { y, y - r, y, y + r, y };
+    canvas.DrawPolyline(markerX, markerY, 5, GraphLineColor, GraphLineWidth);
+}
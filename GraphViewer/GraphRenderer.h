@@ -0,0 +1,107 @@
+﻿#pragma once
+
+#include <memory>
+
+#include "Canvas.h"
+#include "Clipping.h"
+#include "FrameArena.h"
+#include "PointBuffer.h"
+#include "Sampler.h"
+#include "Viewport.h"
+
+// カーソルの描画が縦線から左右にはみ出す幅
+const float CursorExtent = 8.0f;
+
+// 描画の統計（ResetStats するまで Render のたびに足していく）
+struct RenderStats {
+    // 評価した点（区間で評価したときは列）の数
+    // 値が飛んでいるかを調べるための評価は含まない
+    long long samples;
+    // そのうち値が NaN か ±∞ だった数
+    long long nonFinite;
+    // NaN の点で線を切った数
+    long long gaps;
+    // 描画用のアリーナがヒープからブロックを確保した回数
+    // 同じ大きさの描画が続いていれば 0 のまま（アリーナの外での確保は数えない）
+    long long arenaBlockAllocations;
+    // 描画用に確保してあるメモリの大きさ（最後に描いたときの値）
+    long long arenaBytes;
+};
+
+// 1 フレーム分のグラフを GraphCanvas に描く
+// 描画先に依存しないので、描画スレッドからもヘッドレス描画からも使える
+class GraphRenderer {
+public:
+    explicit GraphRenderer(std::unique_ptr<GraphSampler> sampler);
+
+    const GraphSampler& Sampler() const { return *m_sampler; }
+
+    void SetPrecision(EvaluationPrecision precision) { m_precision = precision; }
+
+    const RenderStats& Stats() const { return m_stats; }
+    void ResetStats() { m_stats = RenderStats(); }
+
+    // フレームを描き始める前に呼ぶ
+    // 前のフレームで使ったメモリをまとめて返し、幅 width までの Render で使う分を用意しておく
+    void BeginFrame(float width);
+
+    // 幅 width、高さ height の canvas に描く
+    // transform は canvas の座標と関数の座標の対応
+    // 左右の端をまたぐ線も切れずにつながるように、canvas の外側 1px まで計算する
+    // 途中で使うメモリはアリーナから切り出し、描き終わったら返す
+    void Render(GraphCanvas& canvas, const ViewportTransform& transform, float width, float height);
+
+    // x = cursorX の位置にカーソル（縦線と、その位置の値の印）を重ねて描く
+    // 計算するのはカーソルの位置の 1 点だけ
+    void RenderCursor(GraphCanvas& canvas, const ViewportTransform& transform, float cursorX, float height);
+
+private:
+    // Render の本体（m_arena の Scope の中で呼ぶ）
+    void RenderGraph(GraphCanvas& canvas, const ViewportTransform& transform, float width, float height);
+
+    // count 列を描くときに使う配列を m_arena から切り出す
+    void AllocateBuffers(int count);
+
+    // m_arena がヒープから確保した回数を m_stats に足す
+    void CountArenaAllocations();
+
+    // 画面の x = firstX から step px 刻みで count 個の点の値を values に計算する
+    // 画面上の誤差が 1px に満たないなら float や近似関数で計算し、そうでなければ double で計算し直す
+    // double では隣の点の x を区別できないほど深くズームしているなら DoubleDouble で計算する
+    void SamplePoints(const ViewportTransform& transform, double firstX, double step, int count, double* values, EvaluationPrecision precision);
+
+    // 画面の x の位置の 1 点の値を求める
+    double SampleAt(const ViewportTransform& transform, double x) const;
+
+    // 傾きから曲がり具合を見積もり、曲がっているところだけ細かく計算した折れ線を m_points に作る
+    // 自動微分で評価できなければ false を返す
+    bool SampleAdaptive(const ViewportTransform& transform, int firstX, int count, EvaluationPrecision precision);
+
+    // m_points を結んで描く
+    // 隣の点との差が大きいところは間を二分して調べ、本当に値が飛んでいれば線を切る
+    // 画面の上下に外れた部分は、画面のすぐ外で切り取ってから描く
+    // NaN の点（データの欠け）は描かずに、その前後で線を切る
+    void DrawGraphLine(GraphCanvas& canvas, const ViewportTransform& transform, float height);
+
+    // a と b の間で値が飛んでいるかを二分法で調べる
+    // 飛んでいれば、飛ぶ直前と直後の点を left, right に入れて true を返す
+    // 評価するたびに budget を減らし、足りなくなったら飛んでいないとみなす
+    bool FindDiscontinuity(const ViewportTransform& transform, GraphPoint a, GraphPoint b, int& budget, GraphPoint& left, GraphPoint& right) const;
+
+    std::unique_ptr<GraphSampler> m_sampler;
+    EvaluationPrecision m_precision;
+    RenderStats m_stats;
+
+    // 描画中に使うメモリと、そのうち m_stats に数えたヒープ確保の回数
+    FrameArena m_arena;
+    long long m_arenaAllocations;
+
+    // Render 1 回分の関数の値と画面上の点（AllocateBuffers で m_arena から切り出す）
+    FrameBuffer<double> m_values;
+    FrameBuffer<double> m_slopes;
+    FrameBuffer<double> m_refined;
+    FrameBuffer<Interval> m_envelope;
+    PointBuffer m_points;
+    PointBuffer m_stroke;
+    PointBuffer m_clipped;
+};
@@ -1,42 +1,205 @@
 ﻿#pragma comment(lib, "d2d1.lib")
 
 // C++ ライブラリ
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 // Windows
 #include <Windows.h>
+#include <windowsx.h>
 #include <d2d1.h>
 
-struct InputFunction {
-    // 評価する関数
-    std::function<double(double x)> func;
-    // x 軸の左端
-    double startX;
-    // x 軸の右端
-    double endX;
-    // y 軸の上
-    double startY;
-    // y 軸の下
-    double endY;
-};
+// GraphViewer
+#include "Canvas.h"
+#include "CsvParser.h"
+#include "DataCache.h"
+#include "DirtyRegion.h"
+#include "FastMath.h"
+#include "Formula.h"
+#include "GraphRenderer.h"
+#include "MappedFile.h"
+#include "MinMax.h"
+#include "Prefetcher.h"
+#include "SampledData.h"
+#include "Sampler.h"
+#include "StreamingData.h"
+#include "TileCache.h"
+#include "Viewport.h"
 
 // 電圧 v を表す関数
-double v(double t) {
-    return t < 0 ? 0
-        : t < 3 ? 1 - exp(-2 * t)
-        : -exp(-2 * t) + exp(-2 * (t - 3));
+// 区切りと、区間ごとの式を並べて書く
+// 式は t が double でも Interval（区間）でも計算できるように auto で受け取る
+// 区間で評価できると細い山も見落とさずに描ける
+const auto v = MakePiecewise(
+    { 0.0, 3.0 },
+    [](auto t) { return decltype(t)(0); },                       // t < 0
+    [](auto t) { return 1 - exp(-2 * t); },                      // 0 <= t < 3
+    [](auto t) { return -exp(-2 * t) + exp(-2 * (t - 3)); }      // 3 <= t
+);
+
+// 式を表示するときの最初の表示範囲
+const ViewRange FunctionViewRange = {
+    0.0, 8.0, // 0 秒から 8 秒まで
+    -0.2, 1.2 // -0.2V から 1.2V まで（A キーで見えている値に合わせて自動で決める）
+};
+
+// 標準入力から読むデータを表示するときの最初の表示範囲
+// どんな値が届くかわからないので、最初の 1000 点ほどが入る幅にしておく（1 列だけの行は行番号が x になる）
+const ViewRange StreamViewRange = {
+    0.0, 1000.0,
+    -1.0, 1.0
+};
+
+// 読み込めなかった理由を表示する
+void ShowLoadError(const std::string& error)
+{
+    std::wstring message(error.begin(), error.end());
+    MessageBoxW(nullptr, message.c_str(), L"GraphViewer", MB_OK | MB_ICONERROR);
 }
 
-// グラフを表示する関数をつくる
-InputFunction CreateInputFunction()
+// CSV ファイルを読み込む
+// 読み込んだら隣にキャッシュを書いておき、次からは CSV を読み直さずにキャッシュをマップする
+HRESULT LoadCsvData(LPCWSTR path, SampledData& data)
 {
-    return InputFunction{
-        v,
-        0.0, 8.0, // 0 秒から 8 秒まで
-        -0.2, 1.2 // -0.5V から 1.5V まで 
-    };
+    if (SUCCEEDED(OpenDataCache(path, data))) return S_OK;
+
+    MappedFile file;
+    HRESULT hr = file.Open(path);
+    if (FAILED(hr)) {
+        ShowLoadError("cannot open the file");
+        return hr;
+    }
+
+    CsvData csv;
+    std::string error;
+    if (!ParseCsv(file.Data(), file.Size(), csv, error)) {
+        ShowLoadError(error);
+        return E_INVALIDARG;
+    }
+    file.Close();
+
+    data = SampledData(std::move(csv.x), std::move(csv.y));
+
+    // キャッシュを書けなくても（読み取り専用の場所など）表示はできる
+    WriteDataCache(path, data);
+    return S_OK;
+}
+
+// CSV ファイルを読み込んで、点を線でつないだグラフにする
+// 表示範囲はデータの x の範囲全体と、y の範囲に余白をつけたもの
+HRESULT LoadCsvSampler(LPCWSTR path, std::unique_ptr<GraphSampler>& sampler, ViewRange& home)
+{
+    SampledData data;
+    HRESULT hr = LoadCsvData(path, data);
+    if (FAILED(hr)) return hr;
+
+    double startX = data.FirstX();
+    double endX = data.LastX() > startX ? data.LastX() : startX + 1;
+
+    AutoRange range;
+    MinMax values = data.ValueRange();
+    if (!range.Update(values)) {
+        ShowLoadError("no numeric values");
+        return E_INVALIDARG;
+    }
+
+    home = ViewRange{ startX, endX, range.Start(), range.End() };
+    sampler = CreateGraphSampler(std::move(data));
+    return S_OK;
+}
+
+// input から CSV を 1 行ずつ読んで data に足していく（別のスレッドで動かす）
+// 1 列だけの行は行番号を x にする
+// x が数値として読めない行（見出しなど）は飛ばす
+void ReadStream(HANDLE input, StreamingData data)
+{
+    std::string pending;
+    char buffer[4096];
+    DWORD read;
+    double row = 0;
+
+    while (ReadFile(input, buffer, sizeof(buffer), &read, nullptr) && read > 0) {
+        pending.append(buffer, read);
+
+        size_t lineStart = 0;
+        for (size_t newline; (newline = pending.find('\n', lineStart)) != std::string::npos; lineStart = newline + 1) {
+            double values[2];
+            int fields = ParseCsvLine(pending.data() + lineStart, pending.data() + newline, values);
+            if (fields == 1) {
+                data.Append(row++, values[0]);
+            } else if (fields == 2 && !std::isnan(values[0])) {
+                data.Append(values[0], values[1]);
+            }
+        }
+
+        // 改行がまだ届いていない行は次に読んだ分とつなげる
+        pending.erase(0, lineStart);
+    }
+}
+
+// コマンドラインにファイルのパスが書かれていれば CSV として読み込み、- なら標準入力から届く CSV を、
+// 式が書かれていればその式を、なければ v を表示する
+// 例: GraphViewer.exe "-exp(-2 * t) + exp(-2 * (t - 3))"
+//     GraphViewer.exe capture.csv
+//     logger.exe | GraphViewer.exe -
+// 式は読み込むときに定数の畳み込みと共通部分式の除去をしてから評価する
+// home には最初の表示範囲を入れる
+HRESULT CreateSampler(LPCWSTR commandLine, std::unique_ptr<GraphSampler>& sampler, ViewRange& home)
+{
+    std::wstring argument;
+    for (LPCWSTR p = commandLine; *p != L'\0'; p++) {
+        if (*p != L'"') argument.push_back(*p);
+    }
+    size_t first = argument.find_first_not_of(L" \t");
+    if (first == std::wstring::npos) {
+        home = FunctionViewRange;
+        sampler = CreateGraphSampler(v);
+        return S_OK;
+    }
+    argument = argument.substr(first, argument.find_last_not_of(L" \t") - first + 1);
+
+    if (argument == L"-") {
+        // 読み込むスレッドは標準入力が閉じるまで読み続けるので、終わりを待たずに切り離す
+        // 点の列は StreamingData のコピーどうしで共有するので、App が先に終わっても困らない
+        StreamingData data;
+        std::thread(ReadStream, GetStdHandle(STD_INPUT_HANDLE), data).detach();
+        home = StreamViewRange;
+        sampler = CreateGraphSampler(std::move(data));
+        return S_OK;
+    }
+
+    DWORD attributes = GetFileAttributesW(argument.c_str());
+    if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+        return LoadCsvSampler(argument.c_str(), sampler, home);
+    }
+
+    // 式に使える文字は ASCII だけなので、そのまま狭い文字にする
+    std::string text;
+    for (wchar_t c : argument) {
+        text.push_back(c < 0x80 ? static_cast<char>(c) : '?');
+    }
+
+    CompiledFormula formula;
+    std::string error;
+    if (!CompileFormula(text, formula, error)) {
+        ShowLoadError(error);
+        return E_INVALIDARG;
+    }
+
+    home = FunctionViewRange;
+    sampler = CreateGraphSampler(std::move(formula));
+    return S_OK;
 }
 
 // 以下波形レンダリング用コード
@@ -79,9 +242,142 @@ void SafeRelease(Interface **obj)
     }
 }
 
+// Direct2D の RenderTarget に描く GraphCanvas
+class D2DCanvas : public GraphCanvas {
+public:
+    D2DCanvas(ID2D1Factory* pFactory, ID2D1RenderTarget* pRenderTarget, ID2D1SolidColorBrush* pBrush);
+
+    void Clear(GraphColor color) override;
+    void DrawPolyline(const float* xs, const float* ys, int count, GraphColor color, float strokeWidth) override;
+
+    // 描画中に起きた最初のエラー
+    HRESULT Result() const { return m_result; }
+
+private:
+    ID2D1Factory* m_pFactory;
+    ID2D1RenderTarget* m_pRenderTarget;
+    ID2D1SolidColorBrush* m_pBrush;
+    HRESULT m_result;
+};
+
+D2D1_COLOR_F ToColorF(GraphColor color)
+{
+    return D2D1::ColorF(color.r, color.g, color.b, color.a);
+}
+
+// CreatePolylineGeometry で D2D1_POINT_2F に詰め直すときに、一度に詰める点の数
+const int PolylineChunkPoints = 256;
+
+// 点 (xs[i], ys[i]) を結ぶ折れ線を表す PathGeometry を作る
+// Direct2D は点を D2D1_POINT_2F の配列で受け取るので、スタックの配列に少しずつ詰め直して渡す
+// 点の数によらずヒープは使わない
+HRESULT CreatePolylineGeometry(ID2D1Factory* pFactory, const float* xs, const float* ys, int count, ID2D1PathGeometry** ppGeometry)
+{
+    ID2D1PathGeometry* pGeometry = nullptr;
+    ID2D1GeometrySink* pSink = nullptr;
+
+    HRESULT hr = pFactory->CreatePathGeometry(&pGeometry);
+    if (SUCCEEDED(hr)) {
+        hr = pGeometry->Open(&pSink);
+    }
+    if (SUCCEEDED(hr)) {
+        pSink->BeginFigure(D2D1::Point2F(xs[0], ys[0]), D2D1_FIGURE_BEGIN_HOLLOW);
+
+        D2D1_POINT_2F chunk[PolylineChunkPoints];
+        for (int first = 1; first < count; first += PolylineChunkPoints) {
+            int n = std::min(count - first, PolylineChunkPoints);
+            for (int i = 0; i < n; i++) {
+                chunk[i] = D2D1::Point2F(xs[first + i], ys[first + i]);
+            }
+            pSink->AddLines(chunk, static_cast<UINT32>(n));
+        }
+
+        pSink->EndFigure(D2D1_FIGURE_END_OPEN);
+        hr = pSink->Close();
+    }
+
+    SafeRelease(&pSink);
+
+    if (SUCCEEDED(hr)) {
+        *ppGeometry = pGeometry;
+    } else {
+        SafeRelease(&pGeometry);
+    }
+
+    return hr;
+}
+
+D2DCanvas::D2DCanvas(ID2D1Factory* pFactory, ID2D1RenderTarget* pRenderTarget, ID2D1SolidColorBrush* pBrush)
+    : m_pFactory(pFactory),
+    m_pRenderTarget(pRenderTarget),
+    m_pBrush(pBrush),
+    m_result(S_OK)
+{
+}
+
+void D2DCanvas::Clear(GraphColor color)
+{
+    m_pRenderTarget->Clear(ToColorF(color));
+}
+
+void D2DCanvas::DrawPolyline(const float* xs, const float* ys, int count, GraphColor color, float strokeWidth)
+{
+    if (count < 2 || FAILED(m_result)) return;
+
+    // 線分ごとに DrawLine するより、1 つのジオメトリにまとめたほうが Direct2D の呼び出しが少ない
+    ID2D1PathGeometry* pGeometry = nullptr;
+    m_result = CreatePolylineGeometry(m_pFactory, xs, ys, count, &pGeometry);
+    if (FAILED(m_result)) return;
+
+    m_pBrush->SetColor(ToColorF(color));
+    m_pRenderTarget->DrawGeometry(pGeometry, m_pBrush, strokeWidth);
+
+    SafeRelease(&pGeometry);
+}
+
+// タイルキャッシュに使うメモリの上限
+const size_t TileCacheBudgetBytes = 128 * 1024 * 1024;
+
+// 1 フレームで新しく描くタイルの上限
+// 足りない分は次のフレームで描くので、ズーム直後でも描画スレッドが長く止まらない
+const int MaxTilesPerFrame = 4;
+
+// y 軸の範囲を自動で決めるときに覚えておくタイルごとの関数の値のメモリの上限
+const size_t SampleCacheBudgetBytes = 16 * 1024 * 1024;
+
+// パンしている向きに、この時間で見えるようになる分のデータを先読みする（秒）
+const double PrefetchSeconds = 0.5;
+
+// 先読みするタイルの数の上限（片側）
+const int MaxPrefetchTiles = 16;
+
+// これより遅ければ止まっているとみなして、両側を 1 枚ずつ先読みする（px/s）
+const double MinPanVelocity = 50;
+
+// データが変わったかを調べるタイマーの ID と間隔（ミリ秒）
+// 届いたデータは、この間隔でまとめて描き直す
+const UINT_PTR RevisionTimerId = 1;
+const UINT RevisionTimerInterval = 100;
+
+// 描画スレッドに渡す 1 フレーム分の描画依頼
+struct FrameRequest {
+    D2D1_SIZE_U size;
+    Viewport viewport;
+    // 描き直す列
+    DirtyRegion dirty;
+    // カーソルを描くなら、その x 座標
+    bool cursorVisible;
+    FLOAT cursorX;
+    // y 軸の範囲を見えている値に合わせるか
+    bool autoRangeY;
+    // 関数を評価するときの精度
+    EvaluationPrecision precision;
+};
+
 class App {
 public:
-    App(InputFunction inputFunction);
+    // home は最初の表示範囲
+    App(std::unique_ptr<GraphSampler> sampler, const ViewRange& home);
     ~App();
 
     // Direct2D の初期化と画面表示
@@ -97,43 +393,175 @@ private:
     // ウィンドウイベント処理
     LRESULT WndProcCore(UINT message, WPARAM wParam, LPARAM lParam);
 
+    void OnResize(UINT32 width, UINT32 height);
+    void OnMouseDown(int x);
+    void OnMouseMove(int x);
+    void OnMouseUp();
+    void OnMouseLeave();
+    void OnMouseWheel(int delta, int screenX, int screenY);
+    void OnPaint();
+
+    // データが変わっていたら全体を描き直させる
+    void OnRevisionTimer();
+
+    // 最初の表示範囲に戻す（m_renderMutex を取ってから呼ぶ）
+    void ResetViewport();
+
+    // カーソルを描いている列を描き直しにする（m_renderMutex を取ってから呼ぶ）
+    void InvalidateCursor();
+
+    // ウィンドウの px を Direct2D の DIP に変換する
+    FLOAT PixelsToDips(int pixels) const;
+
+    // m_dirty に追加した範囲の描画を描画スレッドに頼む
+    // 描画中に何度呼ばれても、次のフレーム 1 回にまとめられる
+    void RequestRender();
+
+    // 描画スレッドを止めて、終わるまで待つ
+    void StopRenderThread();
+
+    // 以下は描画スレッドで動く
+
+    // 描画スレッドの本体
+    void RenderThreadMain();
+
     // Direct2D 描画コンテキストの初期化
-    HRESULT CreateDeviceResources();
+    HRESULT CreateDeviceResources(D2D1_SIZE_U size);
+    void DiscardDeviceResources();
 
-    void OnResize(UINT32 width, UINT32 height);
-    HRESULT OnRender();
+    HRESULT OnRender(const FrameRequest& request);
 
-    // 以下フィールド
-    InputFunction m_inputFunction;
+    // 画面に見えている範囲の関数の値の最小値と最大値を求める
+    // DataSource::Query で列ごとにまとめた値の範囲を使うので、データの点がいくら多くても画面の幅に比例する手間で済む
+    MinMax ComputeVisibleRange(const Viewport& viewport, FLOAT width);
+
+    // パンの速さから次に見えそうなタイルを決めて、そのデータを先読みさせる
+    void PrefetchAhead(const Viewport& viewport, FLOAT width);
 
+    // タイル 1 枚を描く
+    HRESULT RenderTile(const TileKey& key, const Viewport& viewport, FLOAT height, ID2D1BitmapRenderTarget** ppTile);
+
+    // 以下フィールド
     HWND m_hwnd;
     ID2D1Factory* m_pDirect2dFactory;
+    FLOAT m_dpiX;
+    ViewRange m_home;
+
+    // 以下は UI スレッドだけが触る
+    // ドラッグ中なら、開始時のマウスの位置と表示範囲の左端
+    bool m_dragging;
+    FLOAT m_dragStartX;
+    int64_t m_dragStartOrigin;
+    // ホイールの回転量の WHEEL_DELTA に満たない分
+    int m_wheelRemainder;
+    // WM_MOUSELEAVE を待っているか
+    bool m_trackingMouse;
+    // 最後に描き直させたときのデータの番号
+    uint64_t m_requestedRevision;
+
+    // 以下は描画スレッドだけが触る
+    GraphRenderer m_renderer;
     ID2D1HwndRenderTarget* m_pRenderTarget;
+    D2D1_SIZE_U m_renderTargetSize;
+
+    // 画面外でグラフを描いておく先
+    // 前のフレームの内容を残しておいて、描き直しが必要な列だけ描き直す
+    ID2D1BitmapRenderTarget* m_pFrameTarget;
+    // m_pFrameTarget に前のフレームが全部描けているか
+    bool m_frameValid;
 
-    // グラフの線の色（赤）
+    // グラフの線を描くブラシ（色は描くときに設定する）
     ID2D1SolidColorBrush* m_pGraphLineBrush;
+
+    // 描いたタイルと、そのときの縦方向の表示範囲と px あたりの幅
+    // これらまたはデータが変わったらタイルは使えないので捨てる
+    TileCache<ID2D1BitmapRenderTarget*> m_tileCache;
+    double m_tileBaseUnitsPerPixel;
+    double m_tileStartY;
+    double m_tileEndY;
+    FLOAT m_tileHeight;
+    EvaluationPrecision m_tilePrecision;
+    uint64_t m_tileRevision;
+
+    // y 軸の範囲を自動で決めるときに使う、タイルごとに求めた 1px の列ごとの関数の値の範囲
+    // 値は y 軸の範囲によらないので、px あたりの幅またはデータが変わったときだけ捨てる
+    TileCache<std::vector<MinMax>> m_sampleCache;
+    double m_sampleBaseUnitsPerPixel;
+    AutoRange m_autoRange;
+
+    // ComputeVisibleRange でタイルの値を求めるときに使い回す配列
+    std::vector<double> m_visibleSamples;
+    DataSpan m_visibleSpan;
+
+    // パンの速さと、それに合わせてデータを読んでおくスレッド
+    // 先読みする範囲の配列はフレームごとに使い回す
+    PanTracker m_panTracker;
+    Prefetcher m_prefetcher;
+    std::vector<PrefetchRange> m_prefetchRanges;
+
+    // 以下は UI スレッドと描画スレッドで共有するので m_renderMutex で守る
+    std::thread m_renderThread;
+    std::mutex m_renderMutex;
+    std::condition_variable m_renderCondition;
+    bool m_stopRequested;
+    D2D1_SIZE_U m_clientSize;
+    Viewport m_viewport;
+    DirtyRegion m_dirty;
+    bool m_cursorVisible;
+    FLOAT m_cursorX;
+    bool m_autoRangeY;
+    EvaluationPrecision m_precision;
 };
 
-App::App(InputFunction inputFunction)
-    : m_inputFunction(inputFunction),
-    m_hwnd(nullptr),
+App::App(std::unique_ptr<GraphSampler> sampler, const ViewRange& home)
+    : m_hwnd(nullptr),
     m_pDirect2dFactory(nullptr),
+    m_dpiX(96.0f),
+    m_home(home),
+    m_dragging(false),
+    m_dragStartX(0),
+    m_dragStartOrigin(0),
+    m_wheelRemainder(0),
+    m_trackingMouse(false),
+    m_requestedRevision(0),
+    m_renderer(std::move(sampler)),
     m_pRenderTarget(nullptr),
-    m_pGraphLineBrush(nullptr)
+    m_renderTargetSize(D2D1::SizeU()),
+    m_pFrameTarget(nullptr),
+    m_frameValid(false),
+    m_pGraphLineBrush(nullptr),
+    m_tileCache(TileCacheBudgetBytes, [](ID2D1BitmapRenderTarget*& pTile) { SafeRelease(&pTile); }),
+    m_tileBaseUnitsPerPixel(0),
+    m_tileStartY(0),
+    m_tileEndY(0),
+    m_tileHeight(0),
+    m_tilePrecision(EvaluationPrecision::Exact),
+    m_tileRevision(0),
+    m_sampleCache(SampleCacheBudgetBytes, [](std::vector<MinMax>&) {}),
+    m_sampleBaseUnitsPerPixel(0),
+    m_visibleSamples(TileWidth),
+    m_prefetcher(m_renderer.Sampler()),
+    m_stopRequested(false),
+    m_clientSize(D2D1::SizeU()),
+    m_viewport(),
+    m_cursorVisible(false),
+    m_cursorX(0),
+    m_autoRangeY(false),
+    m_precision(EvaluationPrecision::Exact)
 {
 }
 
 App::~App()
 {
+    StopRenderThread();
     SafeRelease(&m_pDirect2dFactory);
-    SafeRelease(&m_pRenderTarget);
-    SafeRelease(&m_pGraphLineBrush);
 }
 
 HRESULT App::Initialize(HINSTANCE hInstance)
 {
     // Direct2D 初期化
-    TRYRET(D2D1CreateFactory(D2D1_FACTORY_TYPE_SINGLE_THREADED, &m_pDirect2dFactory));
+    // 描画スレッドから使うのでマルチスレッド用のファクトリにする
+    TRYRET(D2D1CreateFactory(D2D1_FACTORY_TYPE_MULTI_THREADED, &m_pDirect2dFactory));
 
     // ウィンドウ作成
     WNDCLASSEX wcex;
@@ -161,6 +589,7 @@ HRESULT App::Initialize(HINSTANCE hInstance)
 
     FLOAT dpiX, dpiY;
     m_pDirect2dFactory->GetDesktopDpi(&dpiX, &dpiY);
+    m_dpiX = dpiX;
 
     m_hwnd = CreateWindow(
         (LPCTSTR)atom,
@@ -184,6 +613,20 @@ HRESULT App::Initialize(HINSTANCE hInstance)
         return E_FAIL;
     }
 
+    RECT clientRect;
+    GetClientRect(m_hwnd, &clientRect);
+    m_clientSize = D2D1::SizeU(
+        clientRect.right - clientRect.left,
+        clientRect.bottom - clientRect.top
+    );
+    ResetViewport();
+
+    // 描画スレッド開始
+    m_renderThread = std::thread(&App::RenderThreadMain, this);
+
+    // 標準入力から読むデータなどは表示している間に増えるので、ときどき調べる
+    SetTimer(m_hwnd, RevisionTimerId, RevisionTimerInterval, nullptr);
+
     ShowWindow(m_hwnd, SW_SHOWNORMAL);
     UpdateWindow(m_hwnd);
 
@@ -230,51 +673,311 @@ LRESULT App::WndProcCore(UINT message, WPARAM wParam, LPARAM lParam)
         // ウィンドウサイズ変更
         OnResize(LOWORD(lParam), HIWORD(lParam));
         return 0;
+    case WM_LBUTTONDOWN:
+        // ドラッグでパン
+        OnMouseDown(GET_X_LPARAM(lParam));
+        return 0;
+    case WM_MOUSEMOVE:
+        OnMouseMove(GET_X_LPARAM(lParam));
+        return 0;
+    case WM_LBUTTONUP:
+        OnMouseUp();
+        return 0;
+    case WM_MOUSELEAVE:
+        OnMouseLeave();
+        return 0;
+    case WM_CAPTURECHANGED:
+        m_dragging = false;
+        return 0;
+    case WM_MOUSEWHEEL:
+        // ホイールでカーソルの位置を中心にズーム
+        OnMouseWheel(GET_WHEEL_DELTA_WPARAM(wParam), GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
+        return 0;
+    case WM_KEYDOWN:
+        if (wParam == VK_HOME) {
+            // Home キーで最初の表示範囲に戻す
+            {
+                std::lock_guard<std::mutex> lock(m_renderMutex);
+                ResetViewport();
+                m_dirty.AddAll();
+            }
+            RequestRender();
+            return 0;
+        }
+        if (wParam == 'F') {
+            // F キーで近似関数を使うかどうかを切り替える
+            {
+                std::lock_guard<std::mutex> lock(m_renderMutex);
+                m_precision = m_precision == EvaluationPrecision::Exact
+                    ? EvaluationPrecision::Fast
+                    : EvaluationPrecision::Exact;
+                m_dirty.AddAll();
+            }
+            RequestRender();
+            return 0;
+        }
+        if (wParam == 'A') {
+            // A キーで y 軸の範囲の自動調整を切り替える
+            {
+                std::lock_guard<std::mutex> lock(m_renderMutex);
+                m_autoRangeY = !m_autoRangeY;
+                m_dirty.AddAll();
+            }
+            RequestRender();
+            return 0;
+        }
+        break;
+    case WM_TIMER:
+        if (wParam == RevisionTimerId) {
+            OnRevisionTimer();
+            return 0;
+        }
+        break;
     case WM_DISPLAYCHANGE:
         // 画面のスケールが変わったので画面書き換えを要求
         InvalidateRect(m_hwnd, NULL, FALSE);
         return 0;
     case WM_PAINT:
+        // レンダリング要求が来たので描画スレッドに波形を描いてもらう
+        // 描き終わるのは待たずに、すぐメッセージ処理に戻る
+        OnPaint();
+        return 0;
+    case WM_DESTROY:
+        // ウィンドウが消える前に描画スレッドを止める
+        KillTimer(m_hwnd, RevisionTimerId);
+        StopRenderThread();
+        PostQuitMessage(0);
+        return 1;
+    }
+
+    return DefWindowProc(m_hwnd, message, wParam, lParam);
+}
+
+void App::OnResize(UINT32 width, UINT32 height)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_renderMutex);
+        FLOAT oldWidth = PixelsToDips(m_clientSize.width);
+        m_clientSize = D2D1::SizeU(width, height);
+        m_viewport.Resize(oldWidth, PixelsToDips(width));
+        m_dirty.AddAll();
+    }
+
+    RequestRender();
+}
+
+void App::OnMouseDown(int x)
+{
+    SetCapture(m_hwnd);
+    m_dragging = true;
+    m_dragStartX = PixelsToDips(x);
+
+    std::lock_guard<std::mutex> lock(m_renderMutex);
+    m_dragStartOrigin = m_viewport.originPixel;
+}
+
+void App::OnMouseMove(int x)
+{
+    if (!m_trackingMouse) {
+        // ウィンドウから出たらカーソルを消すので WM_MOUSELEAVE をもらう
+        TRACKMOUSEEVENT tme = { sizeof(TRACKMOUSEEVENT), TME_LEAVE, m_hwnd, 0 };
+        m_trackingMouse = TrackMouseEvent(&tme) != FALSE;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_renderMutex);
+
+        if (m_dragging) {
+            // 開始位置からの移動量で決めるので、途中の端数がたまってずれることはない
+            m_viewport.originPixel = m_dragStartOrigin - std::llround(PixelsToDips(x) - m_dragStartX);
+            m_dirty.AddAll();
+        }
+
+        // カーソルは前の位置と新しい位置だけ描き直す
+        if (m_cursorVisible) {
+            InvalidateCursor();
+        }
+        m_cursorVisible = true;
+        m_cursorX = PixelsToDips(x);
+        InvalidateCursor();
+    }
+
+    RequestRender();
+}
+
+void App::OnMouseUp()
+{
+    if (m_dragging) {
+        m_dragging = false;
+        ReleaseCapture();
+    }
+}
+
+void App::OnMouseLeave()
+{
+    m_trackingMouse = false;
+
     {
-        // レンダリング要求が来たので波形を描く
-        HRESULT renderResult = OnRender();
-        if (SUCCEEDED(renderResult)) {
-            ValidateRect(m_hwnd, NULL);
-        } else {
+        std::lock_guard<std::mutex> lock(m_renderMutex);
+        if (!m_cursorVisible) return;
+
+        InvalidateCursor();
+        m_cursorVisible = false;
+    }
+
+    RequestRender();
+}
+
+void App::OnMouseWheel(int delta, int screenX, int screenY)
+{
+    // ホイールの座標はスクリーン座標
+    POINT pt = { screenX, screenY };
+    ScreenToClient(m_hwnd, &pt);
+
+    m_wheelRemainder += delta;
+    int steps = m_wheelRemainder / WHEEL_DELTA;
+    m_wheelRemainder -= steps * WHEEL_DELTA;
+    if (steps == 0) return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_renderMutex);
+        m_viewport.Zoom(steps, PixelsToDips(pt.x));
+        m_dirty.AddAll();
+
+        // ドラッグ中にズームしたら、そこからドラッグし直したことにする
+        if (m_dragging) {
+            m_dragStartX = PixelsToDips(pt.x);
+            m_dragStartOrigin = m_viewport.originPixel;
+        }
+    }
+
+    RequestRender();
+}
+
+void App::OnPaint()
+{
+    // 描き直しが必要な範囲だけ描画スレッドに頼む
+    PAINTSTRUCT ps;
+    BeginPaint(m_hwnd, &ps);
+
+    {
+        std::lock_guard<std::mutex> lock(m_renderMutex);
+        m_dirty.Add(PixelsToDips(ps.rcPaint.left), PixelsToDips(ps.rcPaint.right));
+    }
+
+    EndPaint(m_hwnd, &ps);
+
+    RequestRender();
+}
+
+void App::OnRevisionTimer()
+{
+    // Revision はどのスレッドから呼んでもよい
+    uint64_t revision = m_renderer.Sampler().Revision();
+    if (revision == m_requestedRevision) return;
+    m_requestedRevision = revision;
+
+    {
+        std::lock_guard<std::mutex> lock(m_renderMutex);
+        m_dirty.AddAll();
+    }
+
+    RequestRender();
+}
+
+void App::ResetViewport()
+{
+    m_viewport = FitViewport(m_home, PixelsToDips(m_clientSize.width));
+}
+
+void App::InvalidateCursor()
+{
+    m_dirty.Add(m_cursorX - CursorExtent, m_cursorX + CursorExtent);
+}
+
+FLOAT App::PixelsToDips(int pixels) const
+{
+    return pixels * 96.0f / m_dpiX;
+}
+
+void App::RequestRender()
+{
+    m_renderCondition.notify_one();
+}
+
+void App::StopRenderThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_renderMutex);
+        m_stopRequested = true;
+    }
+
+    m_renderCondition.notify_one();
+
+    if (m_renderThread.joinable()) {
+        m_renderThread.join();
+    }
+}
+
+void App::RenderThreadMain()
+{
+    for (;;) {
+        FrameRequest request;
+
+        {
+            std::unique_lock<std::mutex> lock(m_renderMutex);
+            m_renderCondition.wait(lock, [this] { return !m_dirty.IsEmpty() || m_stopRequested; });
+            if (m_stopRequested) break;
+
+            request.size = m_clientSize;
+            request.viewport = m_viewport;
+            request.dirty = m_dirty;
+            request.cursorVisible = m_cursorVisible;
+            request.cursorX = m_cursorX;
+            request.autoRangeY = m_autoRangeY;
+            request.precision = m_precision;
+            m_dirty.Clear();
+        }
+
+        HRESULT renderResult = OnRender(request);
+        if (FAILED(renderResult)) {
             WriteToDebugConsole([renderResult](std::wostream& s) {
                 s << L"描画エラー "
                     << std::hex << renderResult
                     << std::endl;
             });
         }
-        return 0;
-    }
-    case WM_DESTROY:
-        PostQuitMessage(0);
-        return 1;
     }
 
-    return DefWindowProc(m_hwnd, message, wParam, lParam);
+    // Direct2D のリソースは作ったスレッドで解放する
+    DiscardDeviceResources();
 }
 
-HRESULT App::CreateDeviceResources()
+HRESULT App::CreateDeviceResources(D2D1_SIZE_U size)
 {
     // RenderTarget 作成
     if (m_pRenderTarget == nullptr) {
-        RECT clientRect;
-        GetClientRect(m_hwnd, &clientRect);
-
         TRYRET(m_pDirect2dFactory->CreateHwndRenderTarget(
             D2D1::RenderTargetProperties(), // すべてデフォルト
-            D2D1::HwndRenderTargetProperties(
-                m_hwnd,
-                D2D1::SizeU(
-                    clientRect.right - clientRect.left,
-                    clientRect.bottom - clientRect.top
-                )
-            ),
+            // 描き直した部分だけ画面に出すので、前の内容を残しておく
+            D2D1::HwndRenderTargetProperties(m_hwnd, size, D2D1_PRESENT_OPTIONS_RETAIN_CONTENTS),
             &m_pRenderTarget
         ));
+        m_renderTargetSize = size;
+    } else if (size.width != m_renderTargetSize.width || size.height != m_renderTargetSize.height) {
+        // Direct2D の描画サイズ変更
+        TRYRET(m_pRenderTarget->Resize(size));
+        m_renderTargetSize = size;
+        SafeRelease(&m_pFrameTarget);
+    }
+
+    // 画面外の描画先作成
+    if (m_pFrameTarget == nullptr) {
+        TRYRET(m_pRenderTarget->CreateCompatibleRenderTarget(
+            m_pRenderTarget->GetSize(),
+            &m_pFrameTarget
+        ));
+        m_frameValid = false;
     }
 
     // ブラシ作成
@@ -288,57 +991,341 @@ HRESULT App::CreateDeviceResources()
     return S_OK;
 }
 
-void App::OnResize(UINT32 width, UINT32 height)
+void App::DiscardDeviceResources()
 {
-    if (m_pRenderTarget != nullptr) {
-        // Direct2D の描画サイズ変更
-        m_pRenderTarget->Resize(D2D1::SizeU(width, height));
-    }
+    m_tileCache.Clear();
+    SafeRelease(&m_pGraphLineBrush);
+    SafeRelease(&m_pFrameTarget);
+    SafeRelease(&m_pRenderTarget);
 }
 
-// 与えられた画面上の x 座標に対応する点の座標を求める
-D2D1_POINT_2F ComputePoint(const InputFunction& inputFunction, D2D1_SIZE_F size, int x)
+HRESULT App::OnRender(const FrameRequest& request)
 {
-    double argX = ((double)x / size.width)
-        * (inputFunction.endX - inputFunction.startX)
-        + inputFunction.startX;
+    TRYRET(CreateDeviceResources(request.size));
 
-    double value = inputFunction.func(argX);
+    Viewport viewport = request.viewport;
+    D2D1_SIZE_F frameSize = m_pFrameTarget->GetSize();
+    DirtyRegion dirty = request.dirty;
 
-    double y = size.height - size.height *
-        ((value - inputFunction.startY) / (inputFunction.endY - inputFunction.startY));
+    // 前のフレームで描画に使ったメモリをまとめて返す
+    // 描くのはタイル単位なので、タイルの幅の分を用意しておく
+    m_renderer.BeginFrame(static_cast<float>(TileWidth));
 
-    return D2D1::Point2F(static_cast<FLOAT>(x), static_cast<FLOAT>(y));
-}
+    // データが変わったら、描いたタイルも計算した値も使えない
+    uint64_t revision = m_renderer.Sampler().Revision();
+    if (revision != m_tileRevision) {
+        m_tileCache.Clear();
+        m_sampleCache.Clear();
+        m_tileRevision = revision;
+        dirty.AddAll();
+    }
 
-HRESULT App::OnRender()
-{
-    TRYRET(CreateDeviceResources());
+    // y 軸の範囲を見えている値に合わせる
+    if (request.autoRangeY) {
+        m_autoRange.Update(ComputeVisibleRange(viewport, frameSize.width));
+        viewport.startY = m_autoRange.Start();
+        viewport.endY = m_autoRange.End();
+    } else {
+        m_autoRange.Reset();
+    }
+
+    // 縦方向の表示範囲か px あたりの幅か精度が変わったら、描いたタイルは使えない
+    if (viewport.baseUnitsPerPixel != m_tileBaseUnitsPerPixel
+        || viewport.startY != m_tileStartY
+        || viewport.endY != m_tileEndY
+        || frameSize.height != m_tileHeight
+        || request.precision != m_tilePrecision)
+    {
+        m_tileCache.Clear();
+        m_tileBaseUnitsPerPixel = viewport.baseUnitsPerPixel;
+        m_tileStartY = viewport.startY;
+        m_tileEndY = viewport.endY;
+        m_tileHeight = frameSize.height;
+        m_tilePrecision = request.precision;
+        m_renderer.SetPrecision(request.precision);
+        dirty.AddAll();
+    }
+
+    // 前のフレームが残っていなければ全体を描き直す
+    if (!m_frameValid) {
+        dirty.AddAll();
+    }
+
+    // このフレームを描いている間に、次に見えそうな範囲を読んでおいてもらう
+    PrefetchAhead(viewport, frameSize.width);
+
+    ColumnSpan spans[DirtyRegion::MaxSpans];
+    int spanCount = dirty.Spans(static_cast<int>(ceil(frameSize.width)), spans);
+
+    // 描き直す列にかかるタイルのうち、足りないものを描く
+    // 上限を超えた分は次のフレームに回して、先に描けた分だけ表示する
+    int tilesToRender = MaxTilesPerFrame;
+    DirtyRegion missing;
+    HRESULT hr = S_OK;
+
+    for (int i = 0; i < spanCount && SUCCEEDED(hr); i++) {
+        int64_t firstTile = TileIndexOf(viewport.originPixel + spans[i].left);
+        int64_t lastTile = TileIndexOf(viewport.originPixel + spans[i].right - 1);
 
-    // 描画開始
-    m_pRenderTarget->BeginDraw();
-    m_pRenderTarget->SetTransform(D2D1::Matrix3x2F::Identity());
-    m_pRenderTarget->Clear(D2D1::ColorF(D2D1::ColorF::White));
+        for (int64_t index = firstTile; index <= lastTile && SUCCEEDED(hr); index++) {
+            TileKey key = { viewport.zoomLevel, index };
+            if (m_tileCache.Find(key) != nullptr) continue;
 
-    D2D1_SIZE_F rtSize = m_pRenderTarget->GetSize();
-    D2D1_POINT_2F prevPoint = ComputePoint(m_inputFunction, rtSize, 0);
+            FLOAT left = static_cast<FLOAT>(index * TileWidth - viewport.originPixel);
+            if (tilesToRender == 0) {
+                missing.Add(left, left + TileWidth);
+                continue;
+            }
+            tilesToRender--;
 
-    int maxX = static_cast<int>(ceil(rtSize.width));
+            ID2D1BitmapRenderTarget* pTile = nullptr;
+            hr = RenderTile(key, viewport, frameSize.height, &pTile);
 
-    // 1px ごとに計算して線を引く
-    for (int x = 1; x <= maxX; x++) {
-        D2D1_POINT_2F p = ComputePoint(m_inputFunction, rtSize, x);
-        m_pRenderTarget->DrawLine(prevPoint, p, m_pGraphLineBrush, 2.0, NULL);
-        prevPoint = p;
+            if (SUCCEEDED(hr)) {
+                D2D1_SIZE_U tilePixelSize = pTile->GetPixelSize();
+                m_tileCache.Insert(key, pTile, static_cast<size_t>(tilePixelSize.width) * tilePixelSize.height * 4);
+            }
+        }
+    }
+
+    // このフレームで描いたタイルに NaN や ±∞ の値があれば、その数を出しておく
+    RenderStats stats = m_renderer.Stats();
+    m_renderer.ResetStats();
+    if (stats.nonFinite > 0) {
+        WriteToDebugConsole([stats](std::wostream& s) {
+            s << L"NaN/∞ の点 " << stats.nonFinite << L" / " << stats.samples
+                << L"、線の切れ目 " << stats.gaps
+                << std::endl;
+        });
+    }
+
+    // 同じ大きさで描き続けていれば、描画用のアリーナはブロックを足さない
+    // 足したら（最初のフレームや、ウィンドウを大きくしたあと）出しておく
+    if (stats.arenaBlockAllocations > 0) {
+        WriteToDebugConsole([stats](std::wostream& s) {
+            s << L"描画用アリーナのブロック確保 " << stats.arenaBlockAllocations
+                << L" 回、アリーナ " << stats.arenaBytes << L" バイト"
+                << std::endl;
+        });
     }
 
-    HRESULT hr = m_pRenderTarget->EndDraw();
+    // 描き直す列だけ、タイルを並べてカーソルを重ねる
+    if (SUCCEEDED(hr)) {
+        D2DCanvas canvas(m_pDirect2dFactory, m_pFrameTarget, m_pGraphLineBrush);
+
+        m_pFrameTarget->BeginDraw();
+        m_pFrameTarget->SetTransform(D2D1::Matrix3x2F::Identity());
+
+        for (int i = 0; i < spanCount && SUCCEEDED(hr); i++) {
+            D2D1_RECT_F spanRect = D2D1::RectF(
+                static_cast<FLOAT>(spans[i].left), 0,
+                static_cast<FLOAT>(spans[i].right), frameSize.height
+            );
+
+            m_pFrameTarget->PushAxisAlignedClip(spanRect, D2D1_ANTIALIAS_MODE_ALIASED);
+            m_pFrameTarget->Clear(D2D1::ColorF(D2D1::ColorF::White));
+
+            int64_t firstTile = TileIndexOf(viewport.originPixel + spans[i].left);
+            int64_t lastTile = TileIndexOf(viewport.originPixel + spans[i].right - 1);
+
+            for (int64_t index = firstTile; index <= lastTile && SUCCEEDED(hr); index++) {
+                TileKey key = { viewport.zoomLevel, index };
+                ID2D1BitmapRenderTarget** ppTile = m_tileCache.Find(key);
+                if (ppTile == nullptr) continue;
+
+                ID2D1Bitmap* pTileBitmap = nullptr;
+                hr = (*ppTile)->GetBitmap(&pTileBitmap);
+
+                if (SUCCEEDED(hr)) {
+                    FLOAT left = static_cast<FLOAT>(index * TileWidth - viewport.originPixel);
+                    D2D1_RECT_F destRect = D2D1::RectF(left, 0, left + TileWidth, frameSize.height);
+                    m_pFrameTarget->DrawBitmap(pTileBitmap, &destRect);
+                }
+
+                SafeRelease(&pTileBitmap);
+            }
+
+            if (request.cursorVisible) {
+                m_renderer.RenderCursor(canvas, viewport.Transform(frameSize.height), request.cursorX, frameSize.height);
+            }
+
+            m_pFrameTarget->PopAxisAlignedClip();
+        }
+
+        HRESULT endDrawResult = m_pFrameTarget->EndDraw();
+        if (SUCCEEDED(hr)) {
+            hr = endDrawResult;
+        }
+        if (SUCCEEDED(hr)) {
+            hr = canvas.Result();
+        }
+    }
+
+    // フレームに使い終わったので、上限を超えた分のタイルを捨てる
+    m_tileCache.Trim();
+
+    // 途中で失敗したら、次は全体を描き直す
+    m_frameValid = SUCCEEDED(hr);
+
+    // 描き直した列だけ画面に出す
+    if (SUCCEEDED(hr)) {
+        ID2D1Bitmap* pFrame = nullptr;
+        hr = m_pFrameTarget->GetBitmap(&pFrame);
+
+        if (SUCCEEDED(hr)) {
+            m_pRenderTarget->BeginDraw();
+            m_pRenderTarget->SetTransform(D2D1::Matrix3x2F::Identity());
+
+            for (int i = 0; i < spanCount; i++) {
+                D2D1_RECT_F spanRect = D2D1::RectF(
+                    static_cast<FLOAT>(spans[i].left), 0,
+                    static_cast<FLOAT>(spans[i].right), frameSize.height
+                );
+                m_pRenderTarget->DrawBitmap(pFrame, &spanRect, 1.0f, D2D1_BITMAP_INTERPOLATION_MODE_NEAREST_NEIGHBOR, &spanRect);
+            }
+
+            hr = m_pRenderTarget->EndDraw();
+        }
+
+        SafeRelease(&pFrame);
+    }
 
     // RenderTarget の作り直し
     if (hr == D2DERR_RECREATE_TARGET) {
         hr = S_OK;
-        SafeRelease(&m_pRenderTarget);
-        SafeRelease(&m_pGraphLineBrush);
+        DiscardDeviceResources();
+
+        // 作り直したら全体を描き直す
+        missing.AddAll();
+    }
+
+    // 描けなかったタイルがあれば続けて描く
+    if (!missing.IsEmpty()) {
+        std::lock_guard<std::mutex> lock(m_renderMutex);
+        m_dirty.Merge(missing);
+    }
+
+    return hr;
+}
+
+MinMax App::ComputeVisibleRange(const Viewport& viewport, FLOAT width)
+{
+    if (viewport.baseUnitsPerPixel != m_sampleBaseUnitsPerPixel) {
+        m_sampleCache.Clear();
+        m_sampleBaseUnitsPerPixel = viewport.baseUnitsPerPixel;
+    }
+
+    // 見えている列 [firstPixel, endPixel)
+    int64_t firstPixel = viewport.originPixel;
+    int64_t endPixel = firstPixel + static_cast<int64_t>(ceil(width));
+    MinMax range = EmptyMinMax();
+
+    // タイルと同じ区切りで値を覚えておいて、パンしても新しく見えた分だけ計算する
+    // 毎フレームの計算量は画面の幅に比例するだけで済む
+    for (int64_t index = TileIndexOf(firstPixel); index <= TileIndexOf(endPixel - 1); index++) {
+        TileKey key = { viewport.zoomLevel, index };
+        int64_t tileLeft = index * TileWidth;
+
+        std::vector<MinMax>* pColumns = m_sampleCache.Find(key);
+        if (pColumns == nullptr) {
+            std::vector<MinMax> columns(TileWidth, EmptyMinMax());
+            ViewportTransform transform = viewport.Transform(tileLeft, 1.0);
+            const GraphSampler& sampler = m_renderer.Sampler();
+            double x0 = transform.ToDomainX(0);
+            double x1 = transform.ToDomainX(TileWidth);
+
+            // 深くズームしていれば、double では列の x を区別できないので DoubleDouble で 1 列に 1 点ずつ計算する
+            // そうでなければ、返ってきた列（点が少なければ点そのもの）を、それが入る 1px の列にまとめる
+            if (!CanSampleDouble(x0, x1, transform.scaleX)
+                && sampler.SampleDeep(transform.ToDomainXDeep(0), transform.scaleX, TileWidth, m_visibleSamples.data()))
+            {
+                for (int i = 0; i < TileWidth; i++) {
+                    columns[i] = ComputeMinMax(&m_visibleSamples[i], 1);
+                }
+            } else {
+                DataSpan& span = m_visibleSpan;
+                sampler.Query(x0, x1, TileWidth, span);
+                for (size_t i = 0; i < span.Size(); i++) {
+                    double column = std::floor((span.x[i] - x0) / transform.scaleX);
+                    int c = static_cast<int>(std::max(0.0, std::min(column, TileWidth - 1.0)));
+                    double values[] = { span.min[i], span.max[i] };
+                    columns[c].Include(ComputeMinMax(values, 2));
+                }
+            }
+
+            m_sampleCache.Insert(key, std::move(columns), TileWidth * sizeof(MinMax));
+            pColumns = m_sampleCache.Find(key);
+        }
+
+        int begin = static_cast<int>(std::max<int64_t>(firstPixel - tileLeft, 0));
+        int end = static_cast<int>(std::min<int64_t>(endPixel - tileLeft, TileWidth));
+        range.Include(CombineMinMax(pColumns->data() + begin, end - begin));
+    }
+
+    m_sampleCache.Trim();
+
+    return range;
+}
+
+void App::PrefetchAhead(const Viewport& viewport, FLOAT width)
+{
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    m_panTracker.Update(viewport.zoomLevel, viewport.originPixel, seconds);
+    double velocity = m_panTracker.Velocity();
+
+    // 見えている列 [firstPixel, endPixel)
+    int64_t firstPixel = viewport.originPixel;
+    int64_t endPixel = firstPixel + static_cast<int64_t>(ceil(width));
+
+    // 動いている向きに PrefetchSeconds 秒分、止まっていれば両側に 1 枚ずつ
+    int aheadTiles = static_cast<int>(std::min<double>(ceil(fabs(velocity) * PrefetchSeconds / TileWidth), MaxPrefetchTiles));
+    aheadTiles = std::max(aheadTiles, 1);
+    int rightTiles = velocity >= MinPanVelocity ? aheadTiles : velocity <= -MinPanVelocity ? 0 : 1;
+    int leftTiles = velocity <= -MinPanVelocity ? aheadTiles : velocity >= MinPanVelocity ? 0 : 1;
+
+    // 画面に近いタイルから順に並べる（描いてあるタイルは読まなくてよい）
+    std::vector<PrefetchRange>& ranges = m_prefetchRanges;
+    ranges.clear();
+    int64_t firstTile = TileIndexOf(firstPixel);
+    int64_t lastTile = TileIndexOf(endPixel - 1);
+    for (int i = 1; i <= std::max(leftTiles, rightTiles); i++) {
+        int64_t indices[] = { lastTile + i, firstTile - i };
+        bool wanted[] = { i <= rightTiles, i <= leftTiles };
+        for (int side = 0; side < 2; side++) {
+            TileKey key = { viewport.zoomLevel, indices[side] };
+            if (!wanted[side] || m_tileCache.Contains(key)) continue;
+
+            ViewportTransform transform = viewport.Transform(key.index * TileWidth, 1.0);
+            ranges.push_back(PrefetchRange{ transform.ToDomainX(0), transform.scaleX, TileWidth });
+        }
+    }
+
+    m_prefetcher.Request(ranges);
+}
+
+HRESULT App::RenderTile(const TileKey& key, const Viewport& viewport, FLOAT height, ID2D1BitmapRenderTarget** ppTile)
+{
+    ID2D1BitmapRenderTarget* pTile = nullptr;
+    TRYRET(m_pRenderTarget->CreateCompatibleRenderTarget(
+        D2D1::SizeF(static_cast<FLOAT>(TileWidth), height),
+        &pTile
+    ));
+
+    D2DCanvas canvas(m_pDirect2dFactory, pTile, m_pGraphLineBrush);
+
+    pTile->BeginDraw();
+    pTile->SetTransform(D2D1::Matrix3x2F::Identity());
+    m_renderer.Render(canvas, viewport.Transform(key.index * TileWidth, height), static_cast<float>(TileWidth), height);
+    HRESULT hr = pTile->EndDraw();
+
+    if (SUCCEEDED(hr)) {
+        hr = canvas.Result();
+    }
+
+    if (SUCCEEDED(hr)) {
+        *ppTile = pTile;
+    } else {
+        SafeRelease(&pTile);
     }
 
     return hr;
@@ -348,8 +1335,14 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
 {
     int exitCode = 1;
 
+    std::unique_ptr<GraphSampler> sampler;
+    ViewRange home;
+    if (FAILED(CreateSampler(lpCmdLine, sampler, home))) {
+        return exitCode;
+    }
+
     if (SUCCEEDED(CoInitialize(NULL))) {
-        App app(CreateInputFunction());
+        App app(std::move(sampler), home);
 
         if (SUCCEEDED(app.Initialize(hInstance))) {
             exitCode = app.Run();
@@ -0,0 +1,166 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "FunctionTraits.h"
+
+// 区間 [lo, hi]
+// 関数を区間で評価すると、その x の範囲で関数が取りうる値をすべて含む区間が得られる
+// 丸め誤差で範囲が狭くならないように、計算のたびに 1ulp ずつ外側に広げる
+struct Interval {
+    double lo;
+    double hi;
+
+    Interval() : lo(0), hi(0) {}
+    Interval(double value) : lo(value), hi(value) {}
+    Interval(double lo, double hi) : lo(lo), hi(hi) {}
+
+    double Width() const { return hi - lo; }
+    bool Contains(double value) const { return lo <= value && value <= hi; }
+};
+
+// 2 つの区間を両方含む区間
+inline Interval Hull(const Interval& a, const Interval& b)
+{
+    return Interval(std::min(a.lo, b.lo), std::max(a.hi, b.hi));
+}
+
+// 丸め誤差の分だけ外側に広げる
+inline Interval Widen(double lo, double hi)
+{
+    return Interval(
+        std::nextafter(lo, -std::numeric_limits<double>::infinity()),
+        std::nextafter(hi, std::numeric_limits<double>::infinity())
+    );
+}
+
+inline Interval operator+(const Interval& a, const Interval& b)
+{
+    return Widen(a.lo + b.lo, a.hi + b.hi);
+}
+
+inline Interval operator-(const Interval& a)
+{
+    return Interval(-a.hi, -a.lo);
+}
+
+inline Interval operator-(const Interval& a, const Interval& b)
+{
+    return Widen(a.lo - b.hi, a.hi - b.lo);
+}
+
+inline Interval operator*(const Interval& a, const Interval& b)
+{
+    double p1 = a.lo * b.lo;
+    double p2 = a.lo * b.hi;
+    double p3 = a.hi * b.lo;
+    double p4 = a.hi * b.hi;
+    return Widen(
+        std::min(std::min(p1, p2), std::min(p3, p4)),
+        std::max(std::max(p1, p2), std::max(p3, p4))
+    );
+}
+
+inline Interval operator/(const Interval& a, const Interval& b)
+{
+    // 0 をまたぐ区間で割ると値はどこまでも大きくなる
+    if (b.Contains(0.0)) {
+        return Interval(-std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity());
+    }
+    return a * Widen(1.0 / b.hi, 1.0 / b.lo);
+}
+
+// 以下、単調な関数は両端を評価すればよい
+
+inline Interval exp(const Interval& x)
+{
+    return Widen(std::exp(x.lo), std::exp(x.hi));
+}
+
+inline Interval log(const Interval& x)
+{
+    return Widen(
+        x.lo > 0 ? std::log(x.lo) : -std::numeric_limits<double>::infinity(),
+        std::log(x.hi)
+    );
+}
+
+inline Interval sqrt(const Interval& x)
+{
+    return Widen(std::sqrt(std::max(x.lo, 0.0)), std::sqrt(x.hi));
+}
+
+inline Interval fabs(const Interval& x)
+{
+    if (x.lo >= 0) return x;
+    if (x.hi <= 0) return -x;
+    return Interval(0.0, std::max(-x.lo, x.hi));
+}
+
+// sin は区間内に山（π/2 + 2kπ）か谷（-π/2 + 2kπ）があればそこで ±1 になる
+inline Interval sin(const Interval& x)
+{
+    const double pi = 3.14159265358979323846;
+    if (!(x.Width() < 2 * pi)) return Interval(-1.0, 1.0);
+
+    Interval r = Widen(std::min(std::sin(x.lo), std::sin(x.hi)), std::max(std::sin(x.lo), std::sin(x.hi)));
+
+    // 区間の左端より右にある最初の山と谷
+    double peak = std::ceil((x.lo - pi / 2) / (2 * pi)) * (2 * pi) + pi / 2;
+    double trough = std::ceil((x.lo + pi / 2) / (2 * pi)) * (2 * pi) - pi / 2;
+    if (peak <= x.hi) r.hi = 1.0;
+    if (trough <= x.hi) r.lo = -1.0;
+
+    return Interval(std::max(r.lo, -1.0), std::min(r.hi, 1.0));
+}
+
+inline Interval cos(const Interval& x)
+{
+    const double pi = 3.14159265358979323846;
+    return sin(x + pi / 2);
+}
+
+// 区間どうしの比較の結果
+// 区間の中に両方の場合があるときは Maybe
+enum class IntervalBool {
+    False,
+    True,
+    Maybe
+};
+
+inline IntervalBool operator<(const Interval& a, const Interval& b)
+{
+    if (a.hi < b.lo) return IntervalBool::True;
+    if (a.lo >= b.hi) return IntervalBool::False;
+    return IntervalBool::Maybe;
+}
+
+inline IntervalBool operator>(const Interval& a, const Interval& b)
+{
+    return b < a;
+}
+
+// 条件で値を選ぶ（三項演算子の代わり）
+// 区間のとき、条件がどちらとも言えなければ両方を含む区間になる
+inline double Select(bool condition, double ifTrue, double ifFalse)
+{
+    return condition ? ifTrue : ifFalse;
+}
+
+inline Interval Select(IntervalBool condition, const Interval& ifTrue, const Interval& ifFalse)
+{
+    switch (condition) {
+    case IntervalBool::True:
+        return ifTrue;
+    case IntervalBool::False:
+        return ifFalse;
+    default:
+        return Hull(ifTrue, ifFalse);
+    }
+}
+
+// F が区間で評価できるか
+template<class F>
+using SupportsInterval = SupportsArgument<F, Interval>;
@@ -0,0 +1,77 @@
+﻿#include "MappedFile.h"
+
+// C++ ライブラリ
+#include <cstdint>
+#include <limits>
+
+MappedFile::MappedFile()
+    : m_file(INVALID_HANDLE_VALUE),
+    m_mapping(nullptr),
+    m_data(nullptr),
+    m_size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+HRESULT MappedFile::Open(LPCWSTR path, bool sequential)
+{
+    Close();
+
+    DWORD flags = FILE_ATTRIBUTE_NORMAL | (sequential ? FILE_FLAG_SEQUENTIAL_SCAN : 0);
+    m_file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) return HRESULT_FROM_WIN32(GetLastError());
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size)) {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+
+    // 32 ビット版ではアドレス空間に収まらないファイルはマップできない
+    if (static_cast<uint64_t>(size.QuadPart) > std::numeric_limits<size_t>::max()) {
+        Close();
+        return HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+    }
+
+    // 空のファイルはマップできないので、何も読まずに終わる
+    m_size = static_cast<size_t>(size.QuadPart);
+    if (m_size == 0) return S_OK;
+
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping == nullptr) {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+
+    m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_data == nullptr) {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+
+    return S_OK;
+}
+
+void MappedFile::Close()
+{
+    if (m_data != nullptr) {
+        UnmapViewOfFile(m_data);
+        m_data = nullptr;
+    }
+    if (m_mapping != nullptr) {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+    m_size = 0;
+}
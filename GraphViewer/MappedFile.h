@@ -0,0 +1,30 @@
+﻿#pragma once
+
+#include <cstddef>
+
+#include <Windows.h>
+
+// 読み取り専用でメモリにマップしたファイル
+// 読み込むためのバッファを確保せず、ページキャッシュをそのまま読む
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // sequential なら先頭から順に読むことを OS に伝えて開く（先読みが大きくなる）
+    HRESULT Open(LPCWSTR path, bool sequential = true);
+    void Close();
+
+    // 空のファイルなら nullptr
+    const char* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+private:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    HANDLE m_file;
+    HANDLE m_mapping;
+    const char* m_data;
+    size_t m_size;
+};
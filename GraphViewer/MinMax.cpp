@@ -0,0 +1,119 @@
+﻿#include "MinMax.h"
+
+// C++ ライブラリ
+#include <cmath>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define GRAPHVIEWER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // 表示範囲の上下につける余白（値の範囲に対する割合）
+    const double AutoRangeMargin = 0.05;
+
+    // 値の範囲が表示範囲のこの割合より狭くなったら縮める
+    const double AutoRangeShrinkRatio = 0.6;
+}
+
+MinMax ComputeMinMax(const double* values, int count)
+{
+    MinMax result = EmptyMinMax();
+    int i = 0;
+
+#ifdef GRAPHVIEWER_SSE2
+    // _mm_min_pd(a, b) は a が NaN なら b を返すので、新しい値を a にすると NaN は無視される
+    // ±∞ は有限かどうかのマスクで、比べても結果が変わらない値に置き換える
+    if (count >= 8) {
+        const __m128d zero = _mm_setzero_pd();
+        const __m128d minIdentity = _mm_set1_pd(result.min);
+        const __m128d maxIdentity = _mm_set1_pd(result.max);
+        __m128d lo0 = minIdentity, lo1 = lo0, lo2 = lo0, lo3 = lo0;
+        __m128d hi0 = maxIdentity, hi1 = hi0, hi2 = hi0, hi3 = hi0;
+
+        auto accumulate = [&](__m128d v, __m128d& lo, __m128d& hi) {
+            __m128d finite = _mm_cmpeq_pd(_mm_sub_pd(v, v), zero);
+            lo = _mm_min_pd(_mm_or_pd(_mm_and_pd(finite, v), _mm_andnot_pd(finite, minIdentity)), lo);
+            hi = _mm_max_pd(_mm_or_pd(_mm_and_pd(finite, v), _mm_andnot_pd(finite, maxIdentity)), hi);
+        };
+
+        for (; i + 8 <= count; i += 8) {
+            accumulate(_mm_loadu_pd(values + i), lo0, hi0);
+            accumulate(_mm_loadu_pd(values + i + 2), lo1, hi1);
+            accumulate(_mm_loadu_pd(values + i + 4), lo2, hi2);
+            accumulate(_mm_loadu_pd(values + i + 6), lo3, hi3);
+        }
+
+        __m128d lo = _mm_min_pd(_mm_min_pd(lo0, lo1), _mm_min_pd(lo2, lo3));
+        __m128d hi = _mm_max_pd(_mm_max_pd(hi0, hi1), _mm_max_pd(hi2, hi3));
+        lo = _mm_min_sd(lo, _mm_unpackhi_pd(lo, lo));
+        hi = _mm_max_sd(hi, _mm_unpackhi_pd(hi, hi));
+        result.min = _mm_cvtsd_f64(lo);
+        result.max = _mm_cvtsd_f64(hi);
+    }
+#endif
+
+    for (; i < count; i++) {
+        double v = values[i];
+        if (!std::isfinite(v)) continue;
+        if (v < result.min) result.min = v;
+        if (v > result.max) result.max = v;
+    }
+
+    return result;
+}
+
+int CountNonFinite(const double* values, int count)
+{
+    int result = 0;
+    int i = 0;
+
+#ifdef GRAPHVIEWER_SSE2
+    const __m128d zero = _mm_setzero_pd();
+    for (; i + 2 <= count; i += 2) {
+        __m128d v = _mm_loadu_pd(values + i);
+        // 有限なら x - x == 0 のビットが立つ
+        int finite = _mm_movemask_pd(_mm_cmpeq_pd(_mm_sub_pd(v, v), zero));
+        result += 2 - (finite & 1) - (finite >> 1);
+    }
+#endif
+
+    for (; i < count; i++) {
+        if (!std::isfinite(values[i])) result++;
+    }
+
+    return result;
+}
+
+AutoRange::AutoRange()
+    : m_valid(false),
+    m_start(0),
+    m_end(0)
+{
+}
+
+bool AutoRange::Update(const MinMax& data)
+{
+    if (data.IsEmpty() || !std::isfinite(data.min) || !std::isfinite(data.max)) {
+        return false;
+    }
+
+    double span = data.max - data.min;
+    if (span <= 0) {
+        // 平らなときは値の大きさに合わせて幅を持たせる
+        span = std::fabs(data.min) > 0 ? std::fabs(data.min) * 0.1 : 1.0;
+    }
+
+    if (m_valid) {
+        bool fits = data.min >= m_start && data.max <= m_end;
+        bool tooLoose = span < (m_end - m_start) * AutoRangeShrinkRatio;
+        if (fits && !tooLoose) return false;
+    }
+
+    double center = (data.min + data.max) / 2;
+    double halfHeight = span / 2 + span * AutoRangeMargin;
+    m_start = center - halfHeight;
+    m_end = center + halfHeight;
+    m_valid = true;
+    return true;
+}
@@ -0,0 +1,55 @@
+﻿#pragma once
+
+#include <limits>
+
+// 値の範囲
+// 1 つも値がないときは min > max になる
+struct MinMax {
+    double min;
+    double max;
+
+    bool IsEmpty() const { return !(min <= max); }
+
+    void Include(const MinMax& other)
+    {
+        if (other.min < min) min = other.min;
+        if (other.max > max) max = other.max;
+    }
+};
+
+inline MinMax EmptyMinMax()
+{
+    return MinMax{
+        std::numeric_limits<double>::infinity(),
+        -std::numeric_limits<double>::infinity()
+    };
+}
+
+// values の最小値と最大値を求める（NaN と ±∞ は無視する）
+// SSE2 が使えるときは 2 要素ずつ、独立した 4 組のレジスタでまとめて比べる
+MinMax ComputeMinMax(const double* values, int count);
+
+// values のうち NaN と ±∞ の数
+// x - x が 0 にならない値を SSE2 の比較のマスクでまとめて数える
+int CountNonFinite(const double* values, int count);
+
+// 見えている値の範囲から y 軸の表示範囲を決める
+// 少しパンしただけで表示範囲が変わるとタイルを全部描き直すことになるので、
+// 値がはみ出したら広げ、十分狭くなったときだけ縮める
+class AutoRange {
+public:
+    AutoRange();
+
+    // data が収まるように表示範囲を更新して、変わったら true を返す
+    bool Update(const MinMax& data);
+
+    void Reset() { m_valid = false; }
+
+    double Start() const { return m_start; }
+    double End() const { return m_end; }
+
+private:
+    bool m_valid;
+    double m_start;
+    double m_end;
+};
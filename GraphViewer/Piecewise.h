@@ -0,0 +1,195 @@
+﻿#pragma once
+
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "DoubleDouble.h"
+#include "Dual.h"
+#include "FastMath.h"
+#include "Interval.h"
+
+// 区分ごとに別の式で表す関数
+// breakpoints[i - 1] <= x < breakpoints[i] の範囲では i 番目の式 (kernel) を使う
+// 式の中に場合分けがないので、区分ごとにまとめて計算すればベクトル化できる
+template<class... Kernels>
+class PiecewiseFunction {
+public:
+    static const size_t SegmentCount = sizeof...(Kernels);
+
+    // breakpoints は昇順
+    PiecewiseFunction(const std::array<double, SegmentCount - 1>& breakpoints, Kernels... kernels)
+        : m_breakpoints(breakpoints),
+        m_kernels(std::move(kernels)...)
+    {
+    }
+
+    // x を含む区分の番号
+    size_t SegmentOf(double x) const
+    {
+        size_t segment = 0;
+        while (segment < SegmentCount - 1 && x >= m_breakpoints[segment]) {
+            segment++;
+        }
+        return segment;
+    }
+
+    // 区切りのすぐ近くまで深くズームしても区分を間違えないように、丸めずに比べる
+    size_t SegmentOf(const DoubleDouble& x) const
+    {
+        size_t segment = 0;
+        while (segment < SegmentCount - 1 && !(x < m_breakpoints[segment])) {
+            segment++;
+        }
+        return segment;
+    }
+
+    double operator()(double x) const
+    {
+        double result = 0;
+        VisitKernel(SegmentOf(x), [&](const auto& kernel) { result = kernel(x); });
+        return result;
+    }
+
+    // float で評価する（式がすべて float のまま計算できるときだけ）
+    template<class T, class = typename std::enable_if<
+        std::is_same<T, float>::value && AllReturnArgument<float, Kernels...>::value>::type>
+    float operator()(T x) const
+    {
+        float result = 0;
+        VisitKernel(SegmentOf(x), [&](const auto& kernel) { result = kernel(x); });
+        return result;
+    }
+
+    // 近似関数や自動微分の型（FastDouble, Dual, FastDual）や DoubleDouble で評価する
+    template<class T, class = typename std::enable_if<
+        !std::is_arithmetic<T>::value && !std::is_same<T, Interval>::value && AllSupportArgument<T, Kernels...>::value>::type>
+    T operator()(const T& x) const
+    {
+        T result;
+        VisitKernel(SegmentOf(PointOf(x)), [&](const auto& kernel) { result = kernel(x); });
+        return result;
+    }
+
+    // 区間で評価するときは区切りで区間を分けて、それぞれの式の結果を合わせる
+    // 条件をまたぐ区間でも両方の式を区間全体で評価しなくて済むので、Select より範囲が狭い
+    template<class T, class = typename std::enable_if<
+        std::is_same<T, Interval>::value && AllSupportArgument<Interval, Kernels...>::value>::type>
+    Interval operator()(const T& x) const
+    {
+        bool empty = true;
+        Interval result;
+
+        for (size_t segment = SegmentOf(x.lo); segment < SegmentCount; segment++) {
+            double lo = segment == 0 ? x.lo : std::max(x.lo, m_breakpoints[segment - 1]);
+            if (lo > x.hi) break;
+            double hi = segment == SegmentCount - 1 ? x.hi : std::min(x.hi, m_breakpoints[segment]);
+
+            Interval part;
+            VisitKernel(segment, [&](const auto& kernel) { part = kernel(Interval(lo, hi)); });
+            result = empty ? part : Hull(result, part);
+            empty = false;
+        }
+
+        return result;
+    }
+
+    // x0 + dx * i (0 <= i < count) での値を values に書き込む
+    // T は式に渡す型（double か FastDouble か float）
+    template<class T = double>
+    void Sample(double x0, double dx, int count, double* values) const
+    {
+        ForEachSegment(x0, dx, count, [&](const auto& kernel, int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                values[i] = ValueOf(kernel(T(x0 + dx * i)));
+            }
+        });
+    }
+
+    // x0 + dx * i での値と傾き dy/dx を values, slopes に書き込む
+    // T は傾きを計算する型（Dual か FastDual）
+    template<class T>
+    void SampleSlope(double x0, double dx, int count, double* values, double* slopes) const
+    {
+        ForEachSegment(x0, dx, count, [&](const auto& kernel, int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                SplitDual(kernel(T(x0 + dx * i, 1)), values[i], slopes[i]);
+            }
+        });
+    }
+
+private:
+    static double ValueOf(double value) { return value; }
+    static double ValueOf(FastDouble value) { return value.value; }
+
+    // 区分を決めるための x の値
+    static double PointOf(double x) { return x; }
+    static double PointOf(FastDouble x) { return x.value; }
+    template<class T>
+    static double PointOf(const BasicDual<T>& x) { return PointOf(x.value); }
+    static const DoubleDouble& PointOf(const DoubleDouble& x) { return x; }
+
+    // x0 + dx * i (0 <= i < count) を区分ごとに分けて、visitor(kernel, begin, end) を呼ぶ
+    template<class Visitor>
+    void ForEachSegment(double x0, double dx, int count, Visitor&& visitor) const
+    {
+        int begin = 0;
+
+        for (size_t segment = 0; segment < SegmentCount && begin < count; segment++) {
+            int end = segment == SegmentCount - 1 ? count : FirstIndexAtOrAfter(m_breakpoints[segment], x0, dx, begin, count);
+
+            VisitKernel(segment, [&](const auto& kernel) { visitor(kernel, begin, end); });
+
+            begin = end;
+        }
+    }
+
+    // x0 + dx * i >= x となる最初の i（begin 以上 count 以下）
+    // 割り算の丸めで 1 つずれることがあるので、点で評価するときと同じ式で確かめて直す
+    static int FirstIndexAtOrAfter(double x, double x0, double dx, int begin, int count)
+    {
+        double estimate = (x - x0) / dx;
+        int i = estimate <= begin ? begin
+            : estimate >= count ? count
+            : static_cast<int>(estimate);
+
+        while (i > begin && x0 + dx * (i - 1) >= x) i--;
+        while (i < count && x0 + dx * i < x) i++;
+        return i;
+    }
+
+    // index 番目の式を visitor に渡す
+    template<class Visitor>
+    void VisitKernel(size_t index, Visitor&& visitor) const
+    {
+        VisitKernel(index, visitor, std::integral_constant<size_t, 0>());
+    }
+
+    template<class Visitor, size_t I>
+    void VisitKernel(size_t index, Visitor& visitor, std::integral_constant<size_t, I>) const
+    {
+        if (index == I) {
+            visitor(std::get<I>(m_kernels));
+        } else {
+            VisitKernel(index, visitor, std::integral_constant<size_t, I + 1>());
+        }
+    }
+
+    template<class Visitor>
+    void VisitKernel(size_t, Visitor&, std::integral_constant<size_t, SegmentCount>) const
+    {
+    }
+
+    std::array<double, SegmentCount - 1> m_breakpoints;
+    std::tuple<Kernels...> m_kernels;
+};
+
+// 区切りと、区分ごとの式から PiecewiseFunction を作る
+// 例: MakePiecewise({ 0.0 }, [](auto x) { return -x; }, [](auto x) { return x; })
+template<class... Kernels>
+PiecewiseFunction<Kernels...> MakePiecewise(const std::array<double, sizeof...(Kernels) - 1>& breakpoints, Kernels... kernels)
+{
+    return PiecewiseFunction<Kernels...>(breakpoints, std::move(kernels)...);
+}
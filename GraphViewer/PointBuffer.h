@@ -0,0 +1,63 @@
+﻿#pragma once
+
+#include <cassert>
+#include <cstddef>
+
+#include "Canvas.h"
+#include "FrameArena.h"
+
+// 点の配列をそろえる境界（キャッシュラインの大きさで、AVX-512 のレジスタ 1 本分）
+const size_t PointAlignment = 64;
+
+// FrameArena から切り出した、画面上の点の配列
+// x と y を別々の配列に持つので、y の変換や帯との比較は連続した float をまとめて読むだけでベクトル化できる
+// GraphPoint の配列（x と y が交互に並ぶ）に詰め直すのは、描画先に渡すときだけにする
+class PointBuffer {
+public:
+    PointBuffer() : m_x(nullptr), m_y(nullptr), m_size(0), m_capacity(0) {}
+
+    PointBuffer(FrameArena& arena, size_t capacity)
+        : m_x(static_cast<float*>(arena.Allocate(sizeof(float) * capacity, PointAlignment))),
+        m_y(static_cast<float*>(arena.Allocate(sizeof(float) * capacity, PointAlignment))),
+        m_size(0),
+        m_capacity(capacity)
+    {
+    }
+
+    float* X() { return m_x; }
+    const float* X() const { return m_x; }
+    float* Y() { return m_y; }
+    const float* Y() const { return m_y; }
+
+    size_t Size() const { return m_size; }
+    size_t Capacity() const { return m_capacity; }
+    bool IsEmpty() const { return m_size == 0; }
+
+    GraphPoint operator[](size_t i) const { return GraphPoint{ m_x[i], m_y[i] }; }
+    GraphPoint Back() const { return (*this)[m_size - 1]; }
+
+    void Clear() { m_size = 0; }
+
+    void Push(float x, float y)
+    {
+        assert(m_size < m_capacity);
+        m_x[m_size] = x;
+        m_y[m_size] = y;
+        m_size++;
+    }
+
+    void Push(GraphPoint point) { Push(point.x, point.y); }
+
+    // 要素数を size にする（増えた分は初期化しない）
+    void Resize(size_t size)
+    {
+        assert(size <= m_capacity);
+        m_size = size;
+    }
+
+private:
+    float* m_x;
+    float* m_y;
+    size_t m_size;
+    size_t m_capacity;
+};
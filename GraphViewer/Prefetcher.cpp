@@ -0,0 +1,84 @@
+﻿#include "Prefetcher.h"
+
+namespace {
+    // この時間より長くフレームが空いたら、止まっていたとみなして速さを測り直す（秒）
+    const double PanIdleSeconds = 0.25;
+
+    // 新しく測った速さを混ぜる割合
+    // フレームごとの動きはばらつくので、なめらかにしてから使う
+    const double VelocitySmoothing = 0.5;
+}
+
+PanTracker::PanTracker()
+    : m_valid(false),
+    m_zoomLevel(0),
+    m_originPixel(0),
+    m_seconds(0),
+    m_velocity(0)
+{
+}
+
+void PanTracker::Update(int zoomLevel, int64_t originPixel, double seconds)
+{
+    double elapsed = seconds - m_seconds;
+
+    if (!m_valid || zoomLevel != m_zoomLevel || elapsed > PanIdleSeconds) {
+        m_velocity = 0;
+    } else if (elapsed > 0) {
+        double velocity = static_cast<double>(originPixel - m_originPixel) / elapsed;
+        m_velocity += (velocity - m_velocity) * VelocitySmoothing;
+    }
+
+    m_valid = true;
+    m_zoomLevel = zoomLevel;
+    m_originPixel = originPixel;
+    m_seconds = seconds;
+}
+
+Prefetcher::Prefetcher(const DataSource& source)
+    : m_source(source),
+    m_stopRequested(false),
+    m_next(0)
+{
+    m_thread = std::thread(&Prefetcher::ThreadMain, this);
+}
+
+Prefetcher::~Prefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopRequested = true;
+    }
+
+    m_condition.notify_one();
+    m_thread.join();
+}
+
+void Prefetcher::Request(const std::vector<PrefetchRange>& ranges)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.assign(ranges.begin(), ranges.end());
+        m_next = 0;
+    }
+
+    m_condition.notify_one();
+}
+
+void Prefetcher::ThreadMain()
+{
+    for (;;) {
+        PrefetchRange range;
+
+        // 1 範囲ずつ取り出すので、読んでいる間に新しい範囲が渡されたら次からはそちらを読む
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_next < m_pending.size() || m_stopRequested; });
+            if (m_stopRequested) break;
+
+            range = m_pending[m_next++];
+        }
+
+        m_source.Prefetch(range.x0, range.dx, range.count);
+    }
+}
@@ -0,0 +1,69 @@
+﻿#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "DataSource.h"
+
+// 先読みする範囲（x0 から dx 刻みの count 列）
+struct PrefetchRange {
+    double x0;
+    double dx;
+    int count;
+};
+
+// フレームごとの表示範囲の動きから、パンの速さを見積もる
+class PanTracker {
+public:
+    PanTracker();
+
+    // 時刻 seconds に表示範囲の左端が originPixel になった
+    // ズーム段階が変わったときや、しばらく動かなかったあとは測り直す
+    void Update(int zoomLevel, int64_t originPixel, double seconds);
+
+    // 表示範囲の左端が動く速さ（px/s、右に動くと正）
+    double Velocity() const { return m_velocity; }
+
+private:
+    bool m_valid;
+    int m_zoomLevel;
+    int64_t m_originPixel;
+    double m_seconds;
+    double m_velocity;
+};
+
+// 描画スレッドとは別のスレッドで、これから見えそうな範囲のデータを先に読んでおく
+// マップしたファイルのページの読み込みや圧縮したブロックの展開をこちらで済ませ、描画スレッドが待たされないようにする
+class Prefetcher {
+public:
+    // source は Prefetcher より長く生きていること
+    explicit Prefetcher(const DataSource& source);
+    ~Prefetcher();
+
+    // 先読みする範囲を近い順に渡す
+    // 前に渡した範囲でまだ読んでいないものは、もう要らないので捨てる
+    void Request(const std::vector<PrefetchRange>& ranges);
+
+private:
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+
+    void ThreadMain();
+
+    const DataSource& m_source;
+
+    // 以下は m_mutex で守る
+    // まだ読んでいない範囲は m_pending の m_next 番目から
+    // 毎フレーム渡される範囲を入れ直すので、確保したメモリを使い回せる vector にしておく
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stopRequested;
+    std::vector<PrefetchRange> m_pending;
+    size_t m_next;
+
+    std::thread m_thread;
+};
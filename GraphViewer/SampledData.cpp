@@ -0,0 +1,230 @@
+﻿#include "SampledData.h"
+
+// C++ ライブラリ
+#include <algorithm>
+#include <climits>
+#include <numeric>
+#include <utility>
+
+namespace {
+    // 二分探索の前に順に見る点の数
+    const size_t LinearSearchLength = 8;
+
+    // count が int に収まらないほど多くても ComputeMinMax で調べられるように分ける
+    MinMax ComputeMinMax(const double* values, size_t count)
+    {
+        MinMax range = EmptyMinMax();
+        while (count > 0) {
+            int n = static_cast<int>(std::min<size_t>(count, INT_MAX));
+            range.Include(::ComputeMinMax(values, n));
+            values += n;
+            count -= n;
+        }
+        return range;
+    }
+
+    // 読み込んだ配列の列を持つ
+    struct OwnedColumns {
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<MinMax> blocks;
+    };
+}
+
+std::vector<size_t> SummaryLevelCounts(size_t count, size_t baseBlock)
+{
+    std::vector<size_t> counts;
+    size_t blocks = (count + baseBlock - 1) / baseBlock;
+    while (blocks > 1) {
+        counts.push_back(blocks);
+        blocks = (blocks + SummaryFanout - 1) / SummaryFanout;
+    }
+    return counts;
+}
+
+void BuildSummaryLevels(const double* y, size_t count, MinMax* blocks)
+{
+    std::vector<size_t> counts = SummaryLevelCounts(count);
+    if (counts.empty()) return;
+
+    for (size_t i = 0; i < counts[0]; i++) {
+        size_t first = i * SummaryBaseBlock;
+        blocks[i] = ComputeMinMax(y + first, std::min(SummaryBaseBlock, count - first));
+    }
+
+    BuildUpperSummaryLevels(counts, blocks);
+}
+
+void BuildUpperSummaryLevels(const std::vector<size_t>& counts, MinMax* blocks)
+{
+    MinMax* below = blocks;
+    for (size_t level = 1; level < counts.size(); level++) {
+        MinMax* current = below + counts[level - 1];
+        for (size_t i = 0; i < counts[level]; i++) {
+            size_t first = i * SummaryFanout;
+            current[i] = CombineMinMax(below + first, std::min(SummaryFanout, counts[level - 1] - first));
+        }
+        below = current;
+    }
+}
+
+std::vector<SummaryLevel> MakeSummaryLevels(const MinMax* blocks, const std::vector<size_t>& counts, size_t baseBlock)
+{
+    std::vector<SummaryLevel> levels;
+    size_t blockSize = baseBlock;
+    for (size_t count : counts) {
+        levels.push_back(SummaryLevel{ blocks, count, blockSize });
+        blocks += count;
+        blockSize *= SummaryFanout;
+    }
+    return levels;
+}
+
+SampledData::SampledData(std::vector<double> x, std::vector<double> y)
+{
+    auto columns = std::make_shared<OwnedColumns>();
+
+    if (std::is_sorted(x.begin(), x.end())) {
+        columns->x = std::move(x);
+        columns->y = std::move(y);
+    } else {
+        // 同じ x の点の順番を変えないように stable_sort で並べる
+        std::vector<size_t> order(x.size());
+        std::iota(order.begin(), order.end(), size_t(0));
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return x[a] < x[b]; });
+
+        columns->x.reserve(x.size());
+        columns->y.reserve(y.size());
+        for (size_t i : order) {
+            columns->x.push_back(x[i]);
+            columns->y.push_back(y[i]);
+        }
+    }
+
+    m_x = columns->x.data();
+    m_y = columns->y.data();
+    m_size = columns->x.size();
+    m_firstX = m_size > 0 ? m_x[0] : 0;
+    m_lastX = m_size > 0 ? m_x[m_size - 1] : 0;
+
+    std::vector<size_t> counts = SummaryLevelCounts(m_size);
+    columns->blocks.resize(std::accumulate(counts.begin(), counts.end(), size_t(0)));
+    BuildSummaryLevels(m_y, m_size, columns->blocks.data());
+    m_levels = MakeSummaryLevels(columns->blocks.data(), counts, SummaryBaseBlock);
+
+    m_storage = std::move(columns);
+}
+
+SampledData::SampledData(std::shared_ptr<const void> storage, const double* x, const double* y, size_t size, std::vector<SummaryLevel> levels)
+    : m_storage(std::move(storage)),
+    m_x(x),
+    m_y(y),
+    m_size(size),
+    m_firstX(size > 0 ? x[0] : 0),
+    m_lastX(size > 0 ? x[size - 1] : 0),
+    m_levels(std::move(levels))
+{
+}
+
+SampledData::SampledData(std::shared_ptr<const CompressedSeries> series, std::vector<SummaryLevel> levels)
+    : m_series(std::move(series)),
+    m_x(nullptr),
+    m_y(nullptr),
+    m_size(m_series->Size()),
+    m_firstX(m_size > 0 ? m_series->Block(0).firstX : 0),
+    m_lastX(m_size > 0 ? m_series->Block(m_series->BlockCount() - 1).lastX : 0),
+    m_levels(std::move(levels))
+{
+}
+
+MinMax SampledData::ValueRange(size_t first, size_t last) const
+{
+    return SummaryValueRange(m_levels, first, last, [this](size_t begin, size_t end) { return ScanRange(begin, end); });
+}
+
+MinMax SampledData::ScanRange(size_t first, size_t last) const
+{
+    if (m_series) return m_series->ValueRange(first, last);
+    return ComputeMinMax(m_y + first, last - first);
+}
+
+Interval SampledData::operator()(const Interval& x) const
+{
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    if (m_size == 0 || x.hi < FirstX() || x.lo > LastX()) return Interval(nan, nan);
+
+    double lo = std::max(x.lo, FirstX());
+    double hi = std::min(x.hi, LastX());
+    size_t first = IndexAfter(lo, 0);
+    size_t last = IndexAfter(hi, first);
+
+    // first から last - 1 までの点は lo < x <= hi の範囲にある
+    double ends[] = { (*this)(lo), (*this)(hi) };
+    MinMax range = ComputeMinMax(ends, 2);
+    range.Include(ValueRange(first, last));
+
+    // 端が欠けたところにあれば NaN にして、線を切らせる
+    if (std::isnan(ends[0]) || std::isnan(ends[1]) || range.IsEmpty()) return Interval(nan, nan);
+    return Interval(range.min, range.max);
+}
+
+void SampledData::Prefetch(double x0, double dx, int count) const
+{
+    if (!m_series) return;
+
+    for (int i = 0; i < count; i++) {
+        (*this)(Interval(x0 + dx * i, x0 + dx * (i + 1)));
+    }
+}
+
+void SampledData::Query(double xmin, double xmax, int desiredPoints, DataSpan& span) const
+{
+    span.Clear();
+    if (m_size == 0 || desiredPoints <= 0 || !(xmin < xmax) || xmax < FirstX() || xmin >= LastX()) return;
+
+    size_t first = IndexAfter(xmin, 0);
+    size_t last = IndexAfter(xmax, first);
+
+    if (last - first <= static_cast<size_t>(desiredPoints)) {
+        AppendPoints(first, last, span);
+        return;
+    }
+
+    DecimateRange(first, last, xmin, xmax, desiredPoints,
+        [this](double x, size_t begin) { return IndexAfter(x, begin); },
+        [this](size_t begin, size_t end) { return ValueRange(begin, end); },
+        span);
+}
+
+void SampledData::AppendPoints(size_t first, size_t last, DataSpan& span) const
+{
+    if (!m_series) {
+        for (size_t i = first; i < last; i++) {
+            span.Push(m_x[i], m_y[i], m_y[i]);
+        }
+        return;
+    }
+
+    // ブロックごとに展開して写す
+    for (size_t i = first; i < last;) {
+        size_t block = i / SeriesBlockSize;
+        size_t offset = block * SeriesBlockSize;
+        std::shared_ptr<const DecodedBlock> decoded = m_series->Decode(block);
+        size_t end = std::min(last, offset + decoded->x.size());
+        if (end <= i) break;
+        for (; i < end; i++) {
+            span.Push(decoded->x[i - offset], decoded->y[i - offset], decoded->y[i - offset]);
+        }
+    }
+}
+
+size_t SampledData::IndexAfter(double x, size_t begin) const
+{
+    if (m_series) return m_series->IndexAfter(x, begin);
+
+    size_t end = std::min(begin + LinearSearchLength, m_size);
+    for (size_t i = begin; i < end; i++) {
+        if (x < m_x[i]) return i;
+    }
+    return std::upper_bound(m_x + end, m_x + m_size, x) - m_x;
+}
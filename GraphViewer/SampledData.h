@@ -0,0 +1,223 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "DataSource.h"
+#include "Interval.h"
+#include "MinMax.h"
+#include "SeriesCompression.h"
+
+// y の最小値・最大値をブロックごとにまとめた段
+// 段 0 は SummaryBaseBlock 点（圧縮した列なら SeriesBlockSize 点）ごと、その上の段は下の段の SummaryFanout ブロックごとにまとめる
+struct SummaryLevel {
+    const MinMax* blocks;
+    size_t count;
+    // 1 ブロックに含まれる点の数
+    size_t blockSize;
+};
+
+// 段 0 の 1 ブロックの点の数
+const size_t SummaryBaseBlock = 64;
+// 1 つ上の段で 1 ブロックにまとめる下の段のブロックの数
+const size_t SummaryFanout = 4;
+
+// 測定したデータの点 (x[i], y[i]) を線でつないだ関数
+// 式の関数と同じように評価できるので、同じサンプリングの処理で描ける
+// データの範囲の外と、y が NaN の点（値の欠け）の前後は NaN になる
+//
+// 列は読み込んだ配列でも、マップしたキャッシュファイルでも、ブロックごとに圧縮した列でもよい
+// 列を持っているもの（storage）はコピーしても共有する
+class SampledData {
+public:
+    SampledData() : m_x(nullptr), m_y(nullptr), m_size(0), m_firstX(0), m_lastX(0) {}
+
+    // x の昇順に並べ替えてから持つ（x がすでに昇順なら並べ替えない）
+    // x が同じ点が並んでいるときは、最後の点の値を使う
+    // 範囲の最小値・最大値を速く求めるための段もここで作る
+    SampledData(std::vector<double> x, std::vector<double> y);
+
+    // storage が持っている列をそのまま使う（x は昇順、levels は BuildSummaryLevels と同じ形）
+    SampledData(std::shared_ptr<const void> storage, const double* x, const double* y, size_t size, std::vector<SummaryLevel> levels);
+
+    // 圧縮した列を使う（levels は段 0 が SeriesBlockSize 点ごとで、series の storage の中を指す）
+    // 点が必要になったところのブロックだけを展開する
+    SampledData(std::shared_ptr<const CompressedSeries> series, std::vector<SummaryLevel> levels);
+
+    size_t Size() const { return m_size; }
+    bool IsEmpty() const { return m_size == 0; }
+
+    // 圧縮した列のときは nullptr
+    const double* X() const { return m_x; }
+    const double* Y() const { return m_y; }
+    const std::vector<SummaryLevel>& Levels() const { return m_levels; }
+
+    double FirstX() const { return m_firstX; }
+    double LastX() const { return m_lastX; }
+
+    // すべての点の y の範囲（NaN と ±∞ は無視する）
+    MinMax ValueRange() const { return ValueRange(0, m_size); }
+
+    // first 番目から last - 1 番目までの点の y の範囲
+    // 端の半端な点だけを直接調べ、残りはまとめた段から求めるので、点の数によらずほぼ一定の時間で済む
+    // 圧縮した列でも展開するのは両端のブロックだけ
+    MinMax ValueRange(size_t first, size_t last) const;
+
+    double operator()(double x) const
+    {
+        if (!(m_size > 0 && x >= FirstX() && x <= LastX())) return std::numeric_limits<double>::quiet_NaN();
+        return Interpolate(IndexAfter(x, 0), x);
+    }
+
+    // x の範囲で線が取る値の範囲
+    // 範囲の中の点の最小値・最大値と両端の値を合わせたもので、1 列に何万点あっても細いとげを見落とさない
+    // 範囲の中に欠けた点があっても残りの点の範囲にするが、両端が欠けたところにあれば NaN にする
+    Interval operator()(const Interval& x) const;
+
+    // x0 + dx * i (0 <= i < count) での値を values に書き込む（dx > 0）
+    // 点ごとに二分探索せず、前の点の位置から進めていく
+    void Sample(double x0, double dx, int count, double* values) const
+    {
+        size_t index = 0;
+        for (int i = 0; i < count; i++) {
+            double x = x0 + dx * i;
+            if (!(m_size > 0 && x >= FirstX() && x <= LastX())) {
+                values[i] = std::numeric_limits<double>::quiet_NaN();
+                continue;
+            }
+            index = IndexAfter(x, index);
+            values[i] = Interpolate(index, x);
+        }
+    }
+
+    // x0 + dx * i (0 <= i <= count) で区切った列を描くときに読むところを、先に読んでおく
+    // 圧縮した列なら、描くときと同じ問い合わせをして、目次と段のページを読み込み、端のブロックを展開しておく
+    // 配列の列はメモリにあるので何もしない
+    void Prefetch(double x0, double dx, int count) const;
+
+    // xmin < x <= xmax の点を desiredPoints 列以下にまとめて span に入れる（DataSource::Query）
+    // 点が desiredPoints 以下ならそのまま返し、多ければ列ごとに段から最小値・最大値を求める
+    // 圧縮した列でも展開するのは点をそのまま返すときと、列の端のブロックだけ
+    void Query(double xmin, double xmax, int desiredPoints, DataSpan& span) const;
+
+private:
+    // x < m_x[i] となる最初の i（begin 以上）
+    // 近くにあることが多いので、少し先まで順に見てから二分探索する
+    size_t IndexAfter(double x, size_t begin) const;
+
+    // m_x[index - 1] <= x < m_x[index] の間を直線で補う（index == Size() なら最後の点の値）
+    double Interpolate(size_t index, double x) const
+    {
+        if (m_series) return m_series->Interpolate(index, x);
+        if (index >= m_size) return m_y[m_size - 1];
+        double x0 = m_x[index - 1];
+        double y0 = m_y[index - 1];
+        return y0 + (m_y[index] - y0) * ((x - x0) / (m_x[index] - x0));
+    }
+
+    // first 番目から last - 1 番目までの点を直接調べる
+    MinMax ScanRange(size_t first, size_t last) const;
+
+    // first 番目から last - 1 番目までの点を 1 列ずつ span に足す
+    void AppendPoints(size_t first, size_t last, DataSpan& span) const;
+
+    std::shared_ptr<const void> m_storage;
+    std::shared_ptr<const CompressedSeries> m_series;
+    const double* m_x;
+    const double* m_y;
+    size_t m_size;
+    double m_firstX;
+    double m_lastX;
+    std::vector<SummaryLevel> m_levels;
+};
+
+inline MinMax CombineMinMax(const MinMax* blocks, size_t count)
+{
+    MinMax range = EmptyMinMax();
+    for (size_t i = 0; i < count; i++) {
+        range.Include(blocks[i]);
+    }
+    return range;
+}
+
+// levels の段を使って first 番目から last - 1 番目までの点の y の範囲を求める
+// 段 0 のブロックの境界に満たない両端の点は scan(begin, end) で直接調べる
+template<class Scan>
+MinMax SummaryValueRange(const std::vector<SummaryLevel>& levels, size_t first, size_t last, Scan scan)
+{
+    MinMax range = EmptyMinMax();
+    if (first >= last) return range;
+
+    // 段 0 のブロックの境界まで、両端の点を直接調べる
+    size_t blockSize = levels.empty() ? SummaryBaseBlock : levels[0].blockSize;
+    size_t lo = std::min((first + blockSize - 1) / blockSize * blockSize, last);
+    size_t hi = std::max(last / blockSize * blockSize, lo);
+    range.Include(scan(first, lo));
+    range.Include(scan(hi, last));
+
+    // 上の段のブロックの境界まで、その段のブロックで埋めていく
+    // 段がなくなったら、残りをいちばん上の段のブロックでまとめる
+    for (size_t level = 0; level < levels.size() && lo < hi; level++) {
+        const SummaryLevel& current = levels[level];
+        size_t i = lo / current.blockSize;
+        size_t j = hi / current.blockSize;
+
+        if (level + 1 == levels.size()) {
+            range.Include(CombineMinMax(current.blocks + i, j - i));
+            break;
+        }
+
+        size_t upper = current.blockSize * SummaryFanout;
+        size_t nextLo = std::min((lo + upper - 1) / upper * upper, hi);
+        size_t nextHi = std::max(hi / upper * upper, nextLo);
+        range.Include(CombineMinMax(current.blocks + i, nextLo / current.blockSize - i));
+        range.Include(CombineMinMax(current.blocks + nextHi / current.blockSize, j - nextHi / current.blockSize));
+        lo = nextLo;
+        hi = nextHi;
+    }
+
+    // 段がない（点が少ない）ときは残りも直接調べる
+    if (levels.empty()) range.Include(scan(lo, hi));
+
+    return range;
+}
+
+// first 番目から last - 1 番目までの点（xmin < x <= xmax にあるもの）を desiredPoints 列にまとめて span に足す
+// 列 k は xmin + dx * k < x <= xmin + dx * (k + 1) で、点のない列は足さず、値が全部欠けている列は NaN にする
+// indexAfter(x, begin) は x < x[i] となる最初の i（begin 以上）、valueRange(begin, end) はその間の点の y の範囲
+template<class IndexAfter, class ValueRange>
+void DecimateRange(size_t first, size_t last, double xmin, double xmax, int desiredPoints, IndexAfter indexAfter, ValueRange valueRange, DataSpan& span)
+{
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    double dx = (xmax - xmin) / desiredPoints;
+    size_t begin = first;
+    for (int k = 0; k < desiredPoints && begin < last; k++) {
+        size_t end = k + 1 == desiredPoints ? last : indexAfter(xmin + dx * (k + 1), begin);
+        if (end == begin) continue;
+
+        MinMax range = valueRange(begin, end);
+        if (range.IsEmpty()) {
+            span.Push(xmin + dx * k, nan, nan);
+        } else {
+            span.Push(xmin + dx * k, range.min, range.max);
+        }
+        begin = end;
+    }
+}
+
+// count 点から段 0 が baseBlock 点ごとの段を作るときの、各段のブロックの数
+// 段はこの順に 1 つの配列に続けて並べる
+std::vector<size_t> SummaryLevelCounts(size_t count, size_t baseBlock = SummaryBaseBlock);
+
+// y の count 点の段を blocks に作る（SummaryLevelCounts の合計の数だけ書き込む）
+void BuildSummaryLevels(const double* y, size_t count, MinMax* blocks);
+
+// 段 0 が埋まった blocks から上の段を作る（counts は SummaryLevelCounts の結果）
+void BuildUpperSummaryLevels(const std::vector<size_t>& counts, MinMax* blocks);
+
+// blocks の段を counts と段 0 のブロックの点の数 baseBlock から SummaryLevel に分ける
+std::vector<SummaryLevel> MakeSummaryLevels(const MinMax* blocks, const std::vector<size_t>& counts, size_t baseBlock);
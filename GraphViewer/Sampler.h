@@ -0,0 +1,496 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "DataSource.h"
+#include "DoubleDouble.h"
+#include "Dual.h"
+#include "FastMath.h"
+#include "Formula.h"
+#include "FunctionTraits.h"
+#include "Interval.h"
+#include "Piecewise.h"
+#include "SampledData.h"
+#include "StreamingData.h"
+
+// 関数を評価するときの精度
+enum class EvaluationPrecision {
+    // 標準の関数で計算する（区間で評価できれば区間で評価する）
+    Exact,
+    // 画面上で 1px 未満の誤差で済むなら近似関数で計算する
+    Fast
+};
+
+// x0 から dx 刻みで count 個の点を評価して values に書き込む
+// F が具体的な型ならループ内で展開されるのでベクトル化できる
+template<class F>
+void SampleFunction(const F& func, double x0, double dx, int count, double* values)
+{
+    for (int i = 0; i < count; i++) {
+        values[i] = func(x0 + dx * i);
+    }
+}
+
+// 1 列をさらに半分に分けて範囲を狭める回数の上限
+const int MaxColumnSubdivision = 3;
+
+// x を半分に分けながら区間で評価して範囲を狭める
+// 両端の値の幅と比べて tolerance 以上広くなければ、それ以上分けても狭くならないのでやめる
+template<class F>
+Interval RefineInterval(const F& func, double lo, double hi, double tolerance, int depth)
+{
+    Interval range = func(Interval(lo, hi));
+    if (depth == 0) return range;
+
+    double endsWidth = std::fabs(func(hi) - func(lo));
+    if (range.Width() <= endsWidth + tolerance) return range;
+
+    double mid = lo + (hi - lo) / 2;
+    return Hull(
+        RefineInterval(func, lo, mid, tolerance, depth - 1),
+        RefineInterval(func, mid, hi, tolerance, depth - 1)
+    );
+}
+
+// 列 first から count 列分の x の範囲をまとめて区間で評価する
+// 範囲が tolerance 以下なら、その中の列はすべて同じ範囲とみなしてそれ以上評価しない
+// そうでなければ半分に分けて、1 列になったら列の中を細かく分ける
+template<class F>
+void SampleEnvelopeBlock(const F& func, double x0, double dx, int first, int count, double tolerance, Interval* envelope)
+{
+    Interval range = func(Interval(x0 + dx * first, x0 + dx * (first + count)));
+
+    if (range.Width() <= tolerance) {
+        for (int i = first; i < first + count; i++) {
+            envelope[i] = range;
+        }
+    } else if (count > 1) {
+        int half = count / 2;
+        SampleEnvelopeBlock(func, x0, dx, first, half, tolerance, envelope);
+        SampleEnvelopeBlock(func, x0, dx, first + half, count - half, tolerance, envelope);
+    } else {
+        double lo = x0 + dx * first;
+        envelope[first] = RefineInterval(func, lo, lo + dx, tolerance, MaxColumnSubdivision);
+    }
+}
+
+// 最初にまとめて評価する列の数
+const int EnvelopeBlockColumns = 64;
+
+// x0 + dx * i から x0 + dx * (i + 1) までで関数が取る値の範囲を count 列分求める
+// 各列の範囲は必ず本当の値を含むので、点で評価したときに列の間で見落とす細い山も描ける
+// 滑らかなところは数十列まとめて 1 回の評価で済む
+template<class F>
+void SampleEnvelope(const F& func, double x0, double dx, int count, double tolerance, Interval* envelope)
+{
+    for (int first = 0; first < count; first += EnvelopeBlockColumns) {
+        int blockCount = count - first < EnvelopeBlockColumns ? count - first : EnvelopeBlockColumns;
+        SampleEnvelopeBlock(func, x0, dx, first, blockCount, tolerance, envelope);
+    }
+}
+
+// 区分ごとの関数は区切りで x の範囲を分けて、区間ごとに分岐なしでまとめて計算する
+template<class... Kernels>
+void SampleFunction(const PiecewiseFunction<Kernels...>& func, double x0, double dx, int count, double* values)
+{
+    func.Sample(x0, dx, count, values);
+}
+
+// FastDouble で評価した値のうち、有限でない点だけを double で計算し直す
+// 近似関数は範囲の外の引数で NaN を返すので（FastMath.h）、その点はここで標準の関数の値になる
+// 調べるのはまとめて評価した後に 1 回だけなので、点ごとのループは分岐なしのままベクトル化できる
+template<class F>
+void RecomputeNonFinite(const F& func, double x0, double dx, int count, double* values)
+{
+    // bool の OR はベクトル化されないので、int で数える
+    int nonFinite = 0;
+    for (int i = 0; i < count; i++) {
+        nonFinite |= !(std::fabs(values[i]) <= DBL_MAX);
+    }
+    if (nonFinite == 0) return;
+
+    for (int i = 0; i < count; i++) {
+        if (!(std::fabs(values[i]) <= DBL_MAX)) values[i] = func(x0 + dx * i);
+    }
+}
+
+// 値と傾きのどちらかが有限でない点だけを Dual で計算し直す（FastDual で評価したとき）
+template<class F>
+void RecomputeNonFinite(const F& func, double x0, double dx, int count, double* values, double* slopes)
+{
+    int nonFinite = 0;
+    for (int i = 0; i < count; i++) {
+        nonFinite |= !(std::fabs(values[i]) <= DBL_MAX) | !(std::fabs(slopes[i]) <= DBL_MAX);
+    }
+    if (nonFinite == 0) return;
+
+    for (int i = 0; i < count; i++) {
+        if (!(std::fabs(values[i]) <= DBL_MAX) || !(std::fabs(slopes[i]) <= DBL_MAX)) {
+            SplitDual(func(Dual(x0 + dx * i, 1)), values[i], slopes[i]);
+        }
+    }
+}
+
+// SampleFunction と同じだが、FastDouble で評価して exp などを近似関数にする
+template<class F>
+void SampleFunctionFast(const F& func, double x0, double dx, int count, double* values)
+{
+    for (int i = 0; i < count; i++) {
+        values[i] = func(FastDouble(x0 + dx * i)).value;
+    }
+    RecomputeNonFinite(func, x0, dx, count, values);
+}
+
+template<class... Kernels>
+void SampleFunctionFast(const PiecewiseFunction<Kernels...>& func, double x0, double dx, int count, double* values)
+{
+    func.template Sample<FastDouble>(x0, dx, count, values);
+    RecomputeNonFinite(func, x0, dx, count, values);
+}
+
+// 実行時に読み込んだ式は、命令ごとにまとめて計算する
+inline void SampleFunction(const CompiledFormula& func, double x0, double dx, int count, double* values)
+{
+    func.Sample(x0, dx, count, values);
+}
+
+// 範囲の外の引数は命令ごとに計算し直すが、近似関数用の命令列は exp(k) * exp(p) のように書き換えてあり、
+// 書いたとおりならあふれない x でもあふれることがあるので、その点は RecomputeNonFinite で計算し直す
+inline void SampleFunctionFast(const CompiledFormula& func, double x0, double dx, int count, double* values)
+{
+    func.Sample<FastDouble>(x0, dx, count, values);
+    RecomputeNonFinite(func, x0, dx, count, values);
+}
+
+// 読み込んだデータは、前の点の位置から探して線を補う
+inline void SampleFunction(const SampledData& func, double x0, double dx, int count, double* values)
+{
+    func.Sample(x0, dx, count, values);
+}
+
+inline void SampleFunction(const StreamingData& func, double x0, double dx, int count, double* values)
+{
+    func.Sample(x0, dx, count, values);
+}
+
+// 索引を持つデータなら、xmin < x <= xmax を desiredPoints 列以下にまとめて span に入れて true を返す
+// 関数は索引がないので false を返し、1 列に 1 点ずつ計算する
+template<class F>
+bool QueryFunction(const F&, double, double, int, DataSpan&)
+{
+    return false;
+}
+
+inline bool QueryFunction(const SampledData& func, double xmin, double xmax, int desiredPoints, DataSpan& span)
+{
+    func.Query(xmin, xmax, desiredPoints, span);
+    return true;
+}
+
+inline bool QueryFunction(const StreamingData& func, double xmin, double xmax, int desiredPoints, DataSpan& span)
+{
+    func.Query(xmin, xmax, desiredPoints, span);
+    return true;
+}
+
+// データが変わるたびに増える番号
+// 関数も読み込んだデータも変わらないので 0 のまま
+template<class F>
+uint64_t FunctionRevision(const F&)
+{
+    return 0;
+}
+
+inline uint64_t FunctionRevision(const StreamingData& func)
+{
+    return func.Revision();
+}
+
+// x0 から dx 刻みの count 列を描くときに読むデータを先に読んでおく
+// 関数は計算するだけで読むものがないので何もしない
+template<class F>
+void PrefetchFunction(const F&, double, double, int)
+{
+}
+
+inline void PrefetchFunction(const SampledData& func, double x0, double dx, int count)
+{
+    func.Prefetch(x0, dx, count);
+}
+
+// float や double で評価したときに許す x の丸め誤差（px）
+// x がずれても点が横に少し動くだけなので、傾きによらず見た目は変わらない
+const double MaxRoundingPixelError = 1.0 / 64;
+
+// float で評価したときの値の誤差の見積もり（値の大きさに対する割合）
+// 式の中で丸め誤差が積み重なる分を見込んで、1 回の丸めの 64 倍とする
+const double SingleMaxRelativeError = 64 * FLT_EPSILON;
+
+// 近似関数の誤差の上限を決める画面の高さ（px、Direct2D のビットマップの最大の大きさ）
+const double FastMathReferenceHeight = 16384;
+
+// 近似関数（FastExp・FastLog・FastSin・FastCos）の誤差の上限
+// 大きさ 1 の値の範囲を FastMathReferenceHeight px の高さいっぱいに描いても、ずれが MaxRoundingPixelError px に収まる
+// FastExp・FastLog は相対誤差、FastSin・FastCos は絶対誤差がこれ以下（GraphViewerChecks で確かめる）
+const double FastMathMaxError = MaxRoundingPixelError / FastMathReferenceHeight;
+
+// 近似関数で評価した、大きさ magnitude の値の誤差の見積もり
+// exp・log の相対誤差は値とともに大きくなり、sin・cos の絶対誤差は値が小さくても小さくならないので、両方を足す
+inline double FastMathValueError(double magnitude)
+{
+    return FastMathMaxError * magnitude + FastMathMaxError;
+}
+
+// 1px が unitsPerPixel の幅のとき、firstX から lastX までを float で評価しても
+// x の丸め誤差が MaxRoundingPixelError px に収まるか
+// 深くズームすると 1px の幅が x の大きさに比べて小さくなり、float では足りなくなる
+inline bool CanSampleSingle(double firstX, double lastX, double unitsPerPixel)
+{
+    double extent = std::max(std::fabs(firstX), std::fabs(lastX));
+    return extent * FLT_EPSILON <= std::fabs(unitsPerPixel) * MaxRoundingPixelError;
+}
+
+// CanSampleSingle の double 版
+// さらに深くズームして false になったら、隣の点の x が double では同じ値に丸められてしまうので、DoubleDouble で評価する
+inline bool CanSampleDouble(double firstX, double lastX, double unitsPerPixel)
+{
+    double extent = std::max(std::fabs(firstX), std::fabs(lastX));
+    return extent * DBL_EPSILON <= std::fabs(unitsPerPixel) * MaxRoundingPixelError;
+}
+
+// SampleFunction と同じだが、float で評価する
+template<class F>
+void SampleFunctionSingle(const F& func, double x0, double dx, int count, double* values)
+{
+    for (int i = 0; i < count; i++) {
+        values[i] = func(static_cast<float>(x0 + dx * i));
+    }
+}
+
+template<class... Kernels>
+void SampleFunctionSingle(const PiecewiseFunction<Kernels...>& func, double x0, double dx, int count, double* values)
+{
+    func.template Sample<float>(x0, dx, count, values);
+}
+
+inline void SampleFunctionSingle(const CompiledFormula& func, double x0, double dx, int count, double* values)
+{
+    func.Sample<float>(x0, dx, count, values);
+}
+
+// SampleFunction と同じだが、x を DoubleDouble にして評価する
+// x0 は左端の x を丸めずに持ったもので、dx * i はそこからのずれ
+template<class F>
+void SampleFunctionDeep(const F& func, const DoubleDouble& x0, double dx, int count, double* values)
+{
+    for (int i = 0; i < count; i++) {
+        DoubleDouble y = func(x0 + dx * i);
+        values[i] = y.hi;
+    }
+}
+
+inline void SampleFunctionDeep(const CompiledFormula& func, const DoubleDouble& x0, double dx, int count, double* values)
+{
+    func.SampleDeep(x0, dx, count, values);
+}
+
+// x0 から dx 刻みで count 個の点の値と傾き dy/dx を求める
+// T は傾きを計算する型（Dual か FastDual）
+// FastDual なら、近似関数の範囲の外で NaN になった点を RecomputeNonFinite で計算し直す
+template<class T, class F>
+void SampleFunctionSlope(const F& func, double x0, double dx, int count, double* values, double* slopes)
+{
+    for (int i = 0; i < count; i++) {
+        SplitDual(func(T(x0 + dx * i, 1)), values[i], slopes[i]);
+    }
+    if (std::is_same<T, FastDual>::value) RecomputeNonFinite(func, x0, dx, count, values, slopes);
+}
+
+template<class T, class... Kernels>
+void SampleFunctionSlope(const PiecewiseFunction<Kernels...>& func, double x0, double dx, int count, double* values, double* slopes)
+{
+    func.template SampleSlope<T>(x0, dx, count, values, slopes);
+    if (std::is_same<T, FastDual>::value) RecomputeNonFinite(func, x0, dx, count, values, slopes);
+}
+
+template<class T>
+void SampleFunctionSlope(const CompiledFormula& func, double x0, double dx, int count, double* values, double* slopes)
+{
+    func.SampleSlope<T>(x0, dx, count, values, slopes);
+    if (std::is_same<T, FastDual>::value) RecomputeNonFinite(func, x0, dx, count, values, slopes);
+}
+
+// 関数の型を隠して App から使うためのインターフェイス
+// 仮想呼び出しは Sample 1 回につき 1 回だけで、点ごとの呼び出しは F のまま行う
+// 表示範囲は持たない（App の Viewport が持つ）
+class GraphSampler : public DataSource {
+public:
+    virtual void Sample(double x0, double dx, int count, double* values) const = 0;
+
+    // 近似関数で評価できるなら SampleFunctionFast で計算して true を返す
+    // 誤差は FastMathValueError 程度
+    virtual bool SampleFast(double x0, double dx, int count, double* values) const = 0;
+
+    // float のまま評価できる式なら SampleFunctionSingle で計算して true を返す
+    // 使ってよいかは先に CanSampleSingle で確かめる
+    virtual bool SampleSingle(double x0, double dx, int count, double* values) const = 0;
+
+    // DoubleDouble で評価できるなら SampleFunctionDeep で計算して true を返す
+    // 使うのは CanSampleDouble が false になるほど深くズームしたときだけ
+    virtual bool SampleDeep(const DoubleDouble& x0, double dx, int count, double* values) const = 0;
+
+    // 自動微分で評価できるなら SampleFunctionSlope で値と傾きを求めて true を返す
+    // precision が Fast なら exp などを近似関数で計算する
+    virtual bool SampleSlope(EvaluationPrecision precision, double x0, double dx, int count, double* values, double* slopes) const = 0;
+
+    // 区間で評価できるなら SampleEnvelope で列ごとの範囲を求めて true を返す
+    // tolerance は同じとみなせる値の幅（画面で 1px 未満になる幅を渡す）
+    virtual bool SampleEnvelope(double x0, double dx, int count, double tolerance, Interval* envelope) const = 0;
+};
+
+template<class F>
+class BasicGraphSampler : public GraphSampler {
+public:
+    explicit BasicGraphSampler(F func)
+        : m_func(std::move(func))
+    {
+    }
+
+    void Sample(double x0, double dx, int count, double* values) const override
+    {
+        SampleFunction(m_func, x0, dx, count, values);
+    }
+
+    bool SampleFast(double x0, double dx, int count, double* values) const override
+    {
+        return SampleFast(SupportsArgument<F, FastDouble>(), x0, dx, count, values);
+    }
+
+    bool SampleSingle(double x0, double dx, int count, double* values) const override
+    {
+        return SampleSingle(ReturnsArgument<F, float>(), x0, dx, count, values);
+    }
+
+    bool SampleDeep(const DoubleDouble& x0, double dx, int count, double* values) const override
+    {
+        return SampleDeep(SupportsArgument<F, DoubleDouble>(), x0, dx, count, values);
+    }
+
+    bool SampleSlope(EvaluationPrecision precision, double x0, double dx, int count, double* values, double* slopes) const override
+    {
+        if (precision == EvaluationPrecision::Fast) {
+            return SampleSlope<FastDual>(SupportsArgument<F, FastDual>(), x0, dx, count, values, slopes);
+        }
+        return SampleSlope<Dual>(SupportsArgument<F, Dual>(), x0, dx, count, values, slopes);
+    }
+
+    bool SampleEnvelope(double x0, double dx, int count, double tolerance, Interval* envelope) const override
+    {
+        return SampleEnvelope(SupportsInterval<F>(), x0, dx, count, tolerance, envelope);
+    }
+
+    // 索引を持つデータは QueryFunction で索引から答える
+    // 関数は 1 列に 1 点ずつ、列の左端で計算する（float で足りれば float で計算する）
+    void Query(double xmin, double xmax, int desiredPoints, DataSpan& span) const override
+    {
+        if (QueryFunction(m_func, xmin, xmax, desiredPoints, span)) return;
+
+        span.Clear();
+        if (desiredPoints <= 0 || !(xmin < xmax)) return;
+
+        span.Resize(desiredPoints);
+        double dx = (xmax - xmin) / desiredPoints;
+        for (int i = 0; i < desiredPoints; i++) {
+            span.x[i] = xmin + dx * i;
+        }
+        if (!(CanSampleSingle(xmin, xmax, dx) && SampleSingle(xmin, dx, desiredPoints, span.min.data()))) {
+            Sample(xmin, dx, desiredPoints, span.min.data());
+        }
+        span.max = span.min;
+    }
+
+    void Prefetch(double x0, double dx, int count) const override
+    {
+        PrefetchFunction(m_func, x0, dx, count);
+    }
+
+    uint64_t Revision() const override
+    {
+        return FunctionRevision(m_func);
+    }
+
+private:
+    bool SampleFast(std::true_type, double x0, double dx, int count, double* values) const
+    {
+        SampleFunctionFast(m_func, x0, dx, count, values);
+        return true;
+    }
+
+    bool SampleFast(std::false_type, double, double, int, double*) const
+    {
+        return false;
+    }
+
+    bool SampleSingle(std::true_type, double x0, double dx, int count, double* values) const
+    {
+        SampleFunctionSingle(m_func, x0, dx, count, values);
+        return true;
+    }
+
+    bool SampleSingle(std::false_type, double, double, int, double*) const
+    {
+        return false;
+    }
+
+    bool SampleDeep(std::true_type, const DoubleDouble& x0, double dx, int count, double* values) const
+    {
+        SampleFunctionDeep(m_func, x0, dx, count, values);
+        return true;
+    }
+
+    bool SampleDeep(std::false_type, const DoubleDouble&, double, int, double*) const
+    {
+        return false;
+    }
+
+    template<class T>
+    bool SampleSlope(std::true_type, double x0, double dx, int count, double* values, double* slopes) const
+    {
+        SampleFunctionSlope<T>(m_func, x0, dx, count, values, slopes);
+        return true;
+    }
+
+    template<class T>
+    bool SampleSlope(std::false_type, double, double, int, double*, double*) const
+    {
+        return false;
+    }
+
+    bool SampleEnvelope(std::true_type, double x0, double dx, int count, double tolerance, Interval* envelope) const
+    {
+        ::SampleEnvelope(m_func, x0, dx, count, tolerance, envelope);
+        return true;
+    }
+
+    bool SampleEnvelope(std::false_type, double, double, int, double, Interval*) const
+    {
+        return false;
+    }
+
+    F m_func;
+};
+
+// func を描く GraphSampler を作る
+// 関数の型がそのまま残るので、サンプリング時にインライン展開される
+template<class F>
+std::unique_ptr<GraphSampler> CreateGraphSampler(F func)
+{
+    return std::unique_ptr<GraphSampler>(new BasicGraphSampler<F>(std::move(func)));
+}
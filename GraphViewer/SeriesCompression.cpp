@@ -0,0 +1,474 @@
+﻿#include "SeriesCompression.h"
+
+// C++ ライブラリ
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+    // 1 つのスレッドで圧縮する最小のブロックの数
+    const size_t MinBlocksPerThread = 1024;
+
+    uint64_t ToBits(double value)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    double FromBits(uint64_t bits)
+    {
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // value は 0 でないこと
+    inline int CountLeadingZeros(uint64_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        if (value >> 32) {
+            _BitScanReverse(&index, static_cast<unsigned long>(value >> 32));
+            return 31 - static_cast<int>(index);
+        }
+        _BitScanReverse(&index, static_cast<unsigned long>(value));
+        return 63 - static_cast<int>(index);
+#else
+        return __builtin_clzll(value);
+#endif
+    }
+
+    // value は 0 でないこと
+    inline int CountTrailingZeros(uint64_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        if (static_cast<uint32_t>(value) != 0) {
+            _BitScanForward(&index, static_cast<unsigned long>(value));
+            return static_cast<int>(index);
+        }
+        _BitScanForward(&index, static_cast<unsigned long>(value >> 32));
+        return 32 + static_cast<int>(index);
+#else
+        return __builtin_ctzll(value);
+#endif
+    }
+
+    // value が bits ビットの符号付き整数に収まるか
+    inline bool FitsSigned(int64_t value, int bits)
+    {
+        int64_t limit = int64_t(1) << (bits - 1);
+        return value >= -limit && value < limit;
+    }
+
+    // bits ビットの符号付き整数を 64 ビットに広げる
+    inline int64_t SignExtend(uint64_t value, int bits)
+    {
+        int shift = 64 - bits;
+        return static_cast<int64_t>(value << shift) >> shift;
+    }
+
+    // 上の桁から詰めて書く
+    class BitWriter {
+    public:
+        explicit BitWriter(std::vector<uint8_t>& out) : m_out(out), m_buffer(0), m_bits(0) {}
+
+        // value の下位 bits ビット（64 ビットまで）を書く
+        void Write(uint64_t value, int bits)
+        {
+            if (bits > 32) {
+                Write(value >> 32, bits - 32);
+                bits = 32;
+            }
+            m_buffer = (m_buffer << bits) | (value & ((uint64_t(1) << bits) - 1));
+            m_bits += bits;
+            while (m_bits >= 8) {
+                m_bits -= 8;
+                m_out.push_back(static_cast<uint8_t>(m_buffer >> m_bits));
+            }
+        }
+
+        // 半端なビットを 0 で埋めて書き出す
+        void Flush()
+        {
+            if (m_bits > 0) m_out.push_back(static_cast<uint8_t>(m_buffer << (8 - m_bits)));
+            m_bits = 0;
+        }
+
+    private:
+        std::vector<uint8_t>& m_out;
+        uint64_t m_buffer;
+        int m_bits;
+    };
+
+    // BitWriter で書いたものを読む（終わりより先は 0 として読む）
+    class BitReader {
+    public:
+        BitReader(const uint8_t* data, size_t size) : m_p(data), m_end(data + size), m_buffer(0), m_bits(0) {}
+
+        // 56 ビット以上読める状態にする
+        // 8 バイト残っていれば、バイトごとに分岐せずにまとめて詰める
+        // 詰めきれなかった下の桁にも続きのビットが入るが、次に詰めるときも同じ値なので OR しても変わらない
+        void Refill()
+        {
+            if (m_end - m_p >= 8) {
+                uint64_t value = 0;
+                for (int i = 0; i < 8; i++) {
+                    value = (value << 8) | m_p[i];
+                }
+                m_buffer |= value >> m_bits;
+                int bytes = (63 - m_bits) >> 3;
+                m_p += bytes;
+                m_bits += bytes * 8;
+                return;
+            }
+            while (m_bits <= 56) {
+                uint64_t value = m_p < m_end ? *m_p++ : 0;
+                m_buffer |= value << (56 - m_bits);
+                m_bits += 8;
+            }
+        }
+
+        // bits ビット以上読める状態にする（56 ビットまで）
+        void Ensure(int bits)
+        {
+            if (m_bits < bits) Refill();
+        }
+
+        // 先頭の bits ビット（1 から 56 ビットまで、Ensure したあと）
+        uint64_t Peek(int bits) const { return m_buffer >> (64 - bits); }
+
+        void Skip(int bits)
+        {
+            m_buffer <<= bits;
+            m_bits -= bits;
+        }
+
+        // bits ビット（64 ビットまで）を読む
+        uint64_t Read(int bits)
+        {
+            if (bits > 56) {
+                uint64_t high = Read(bits - 56);
+                return (high << 56) | Read(56);
+            }
+            if (bits == 0) return 0;
+            Ensure(bits);
+            uint64_t value = Peek(bits);
+            Skip(bits);
+            return value;
+        }
+
+    private:
+        const uint8_t* m_p;
+        const uint8_t* m_end;
+        // 上の桁から m_bits ビットが読める
+        uint64_t m_buffer;
+        int m_bits;
+    };
+
+    // 差の差の長さの段階（'10', '110', '1110' のあとのビット数）
+    const int DeltaBits[] = { 7, 12, 20 };
+
+    // 差の差の先頭の 4 ビットから、符号の長さと値のビット数を引く表（値が 64 ビットなら 0 で、別に読む）
+    struct DeltaCode {
+        int prefixBits;
+        int valueBits;
+    };
+    const DeltaCode DeltaCodes[16] = {
+        { 1, 0 }, { 1, 0 }, { 1, 0 }, { 1, 0 }, { 1, 0 }, { 1, 0 }, { 1, 0 }, { 1, 0 },
+        { 2, 7 }, { 2, 7 }, { 2, 7 }, { 2, 7 },
+        { 3, 12 }, { 3, 12 },
+        { 4, 20 },
+        { 4, 0 },
+    };
+
+    void CompressBlock(const double* x, const double* y, size_t count, std::vector<uint8_t>& out)
+    {
+        BitWriter writer(out);
+
+        // x はビット列を整数とみなして差の差を書く
+        // 同じ符号・同じ指数の範囲なら、等間隔の x の差はほぼ一定になる
+        uint64_t previous = ToBits(x[0]);
+        uint64_t previousDelta = 0;
+        writer.Write(previous, 64);
+        for (size_t i = 1; i < count; i++) {
+            uint64_t current = ToBits(x[i]);
+            uint64_t delta = current - previous;
+            int64_t dod = static_cast<int64_t>(delta - previousDelta);
+            if (dod == 0) {
+                writer.Write(0, 1);
+            } else if (FitsSigned(dod, DeltaBits[0])) {
+                writer.Write(0x2, 2);
+                writer.Write(dod, DeltaBits[0]);
+            } else if (FitsSigned(dod, DeltaBits[1])) {
+                writer.Write(0x6, 3);
+                writer.Write(dod, DeltaBits[1]);
+            } else if (FitsSigned(dod, DeltaBits[2])) {
+                writer.Write(0xE, 4);
+                writer.Write(dod, DeltaBits[2]);
+            } else {
+                writer.Write(0xF, 4);
+                writer.Write(dod, 64);
+            }
+            previous = current;
+            previousDelta = delta;
+        }
+
+        // y は前の値との XOR の、0 でない部分だけを書く
+        previous = ToBits(y[0]);
+        writer.Write(previous, 64);
+        int leading = -1;
+        int trailing = 0;
+        for (size_t i = 1; i < count; i++) {
+            uint64_t current = ToBits(y[i]);
+            uint64_t diff = current ^ previous;
+            previous = current;
+            if (diff == 0) {
+                writer.Write(0, 1);
+                continue;
+            }
+
+            int lz = std::min(CountLeadingZeros(diff), 31);
+            int tz = CountTrailingZeros(diff);
+            if (leading >= 0 && lz >= leading && tz >= trailing) {
+                writer.Write(0x2, 2);
+                writer.Write(diff >> trailing, 64 - leading - trailing);
+            } else {
+                leading = lz;
+                trailing = tz;
+                int width = 64 - lz - tz;
+                writer.Write(0x3, 2);
+                writer.Write(lz, 5);
+                writer.Write(width - 1, 6);
+                writer.Write(diff >> tz, width);
+            }
+        }
+
+        writer.Flush();
+    }
+
+    SeriesBlock MakeBlockHeader(const double* x, const double* y, size_t count)
+    {
+        SeriesBlock block = {};
+        block.count = static_cast<uint32_t>(count);
+        block.firstX = x[0];
+        block.firstY = y[0];
+        block.lastX = x[count - 1];
+        block.lastY = y[count - 1];
+        block.range = ComputeMinMax(y, static_cast<int>(count));
+        return block;
+    }
+}
+
+void CompressSeries(const double* x, const double* y, size_t count, std::vector<uint8_t>& data, std::vector<SeriesBlock>& blocks)
+{
+    size_t blockCount = (count + SeriesBlockSize - 1) / SeriesBlockSize;
+    size_t threadCount = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    size_t groupCount = std::min(threadCount, std::max<size_t>(blockCount / MinBlocksPerThread, 1));
+
+    // スレッドごとに続いたブロックを圧縮してから、順につなげる
+    std::vector<std::vector<uint8_t>> groupData(groupCount);
+    std::vector<SeriesBlock> headers(blockCount);
+    auto compressGroup = [&](size_t group) {
+        size_t first = blockCount * group / groupCount;
+        size_t last = blockCount * (group + 1) / groupCount;
+        std::vector<uint8_t>& out = groupData[group];
+        for (size_t i = first; i < last; i++) {
+            size_t begin = i * SeriesBlockSize;
+            size_t n = std::min(SeriesBlockSize, count - begin);
+            size_t offset = out.size();
+            CompressBlock(x + begin, y + begin, n, out);
+            headers[i] = MakeBlockHeader(x + begin, y + begin, n);
+            headers[i].offset = offset;
+            headers[i].size = static_cast<uint32_t>(out.size() - offset);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t group = 0; group + 1 < groupCount; group++) {
+        threads.emplace_back(compressGroup, group);
+    }
+    if (groupCount > 0) compressGroup(groupCount - 1);
+    for (std::thread& t : threads) {
+        t.join();
+    }
+
+    // グループの中の位置を、data の先頭からの位置に直す
+    for (size_t group = 0; group < groupCount; group++) {
+        size_t last = blockCount * (group + 1) / groupCount;
+        for (size_t i = blockCount * group / groupCount; i < last; i++) {
+            headers[i].offset += data.size();
+        }
+        data.insert(data.end(), groupData[group].begin(), groupData[group].end());
+        std::vector<uint8_t>().swap(groupData[group]);
+    }
+
+    blocks.insert(blocks.end(), headers.begin(), headers.end());
+}
+
+void DecompressBlock(const uint8_t* data, size_t size, size_t count, double* x, double* y)
+{
+    if (count == 0) return;
+    BitReader reader(data, size);
+
+    uint64_t previous = reader.Read(64);
+    uint64_t delta = 0;
+    x[0] = FromBits(previous);
+    for (size_t i = 1; i < count; i++) {
+        // 符号と 20 ビットまでの値は 1 回詰めれば読める
+        reader.Ensure(24);
+        const DeltaCode& code = DeltaCodes[reader.Peek(4)];
+        reader.Skip(code.prefixBits);
+        uint64_t dod = 0;
+        if (code.valueBits > 0) {
+            dod = static_cast<uint64_t>(SignExtend(reader.Peek(code.valueBits), code.valueBits));
+            reader.Skip(code.valueBits);
+        } else if (code.prefixBits == 4) {
+            dod = reader.Read(64);
+        }
+        delta += dod;
+        previous += delta;
+        x[i] = FromBits(previous);
+    }
+
+    previous = reader.Read(64);
+    y[0] = FromBits(previous);
+    int leading = 0;
+    int width = 64;
+    for (size_t i = 1; i < count; i++) {
+        reader.Ensure(13);
+        uint64_t control = reader.Peek(2);
+        if (control < 2) {
+            reader.Skip(1);
+        } else {
+            reader.Skip(2);
+            if (control == 3) {
+                leading = static_cast<int>(reader.Peek(5));
+                reader.Skip(5);
+                width = static_cast<int>(reader.Peek(6)) + 1;
+                reader.Skip(6);
+            }
+            // 壊れたデータで幅が 64 ビットを超えても、シフトの範囲に収める
+            int trailing = std::max(64 - leading - width, 0);
+            previous ^= reader.Read(width) << trailing;
+        }
+        y[i] = FromBits(previous);
+    }
+}
+
+CompressedSeries::CompressedSeries(std::shared_ptr<const void> storage, const SeriesBlock* blocks, const uint8_t* data, size_t dataSize, size_t size)
+    : m_storage(std::move(storage)),
+    m_blocks(blocks),
+    m_blockCount((size + SeriesBlockSize - 1) / SeriesBlockSize),
+    m_data(data),
+    m_dataSize(dataSize),
+    m_size(size)
+{
+}
+
+size_t CompressedSeries::BlockPoints(size_t i) const
+{
+    return std::min(SeriesBlockSize, m_size - i * SeriesBlockSize);
+}
+
+std::shared_ptr<const DecodedBlock> CompressedSeries::Decode(size_t i) const
+{
+    {
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        auto found = m_cacheIndex.find(i);
+        if (found != m_cacheIndex.end()) {
+            m_cache.splice(m_cache.begin(), m_cache, found->second);
+            return found->second->second;
+        }
+    }
+
+    // 目次が壊れていても添字が範囲を超えないように、点の数は目次ではなく位置から決める
+    // 位置がデータの外を指していれば、読める分だけ読む
+    const SeriesBlock& block = m_blocks[i];
+    size_t count = BlockPoints(i);
+    auto decoded = std::make_shared<DecodedBlock>();
+    decoded->x.resize(count);
+    decoded->y.resize(count);
+    size_t offset = static_cast<size_t>(std::min<uint64_t>(block.offset, m_dataSize));
+    size_t size = std::min<size_t>(block.size, m_dataSize - offset);
+    DecompressBlock(m_data + offset, size, count, decoded->x.data(), decoded->y.data());
+
+    // 展開している間に別のスレッドが入れていれば、そちらを使う
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    auto found = m_cacheIndex.find(i);
+    if (found != m_cacheIndex.end()) return found->second->second;
+
+    m_cache.emplace_front(i, decoded);
+    m_cacheIndex[i] = m_cache.begin();
+    if (m_cache.size() > DecodedCacheSize) {
+        m_cacheIndex.erase(m_cache.back().first);
+        m_cache.pop_back();
+    }
+    return decoded;
+}
+
+size_t CompressedSeries::IndexAfter(double x, size_t begin) const
+{
+    if (begin >= m_size) return m_size;
+
+    // 次のブロックの最初の点より先なら、目次で x を含むブロックを探す
+    size_t i = begin / SeriesBlockSize;
+    if (i + 1 < m_blockCount && !(x < m_blocks[i + 1].firstX)) {
+        const SeriesBlock* found = std::upper_bound(m_blocks + i + 1, m_blocks + m_blockCount, x,
+            [](double value, const SeriesBlock& block) { return value < block.firstX; });
+        i = found - m_blocks - 1;
+    }
+
+    size_t blockBegin = i * SeriesBlockSize;
+    std::shared_ptr<const DecodedBlock> decoded = Decode(i);
+    const double* xs = decoded->x.data();
+    size_t local = std::max(begin, blockBegin) - blockBegin;
+    return blockBegin + (std::upper_bound(xs + local, xs + decoded->x.size(), x) - xs);
+}
+
+double CompressedSeries::Interpolate(size_t index, double x) const
+{
+    if (index >= m_size) return m_blocks[m_blockCount - 1].lastY;
+
+    size_t i = index / SeriesBlockSize;
+    size_t local = index % SeriesBlockSize;
+    double x0, y0, x1, y1;
+    if (local == 0) {
+        x0 = m_blocks[i - 1].lastX;
+        y0 = m_blocks[i - 1].lastY;
+        x1 = m_blocks[i].firstX;
+        y1 = m_blocks[i].firstY;
+    } else {
+        std::shared_ptr<const DecodedBlock> decoded = Decode(i);
+        x0 = decoded->x[local - 1];
+        y0 = decoded->y[local - 1];
+        x1 = decoded->x[local];
+        y1 = decoded->y[local];
+    }
+    return y0 + (y1 - y0) * ((x - x0) / (x1 - x0));
+}
+
+MinMax CompressedSeries::ValueRange(size_t first, size_t last) const
+{
+    MinMax range = EmptyMinMax();
+    last = std::min(last, m_size);
+    while (first < last) {
+        size_t i = first / SeriesBlockSize;
+        size_t blockBegin = i * SeriesBlockSize;
+        size_t blockEnd = blockBegin + BlockPoints(i);
+        size_t end = std::min(last, blockEnd);
+        if (first == blockBegin && end == blockEnd) {
+            range.Include(m_blocks[i].range);
+        } else {
+            std::shared_ptr<const DecodedBlock> decoded = Decode(i);
+            range.Include(ComputeMinMax(decoded->y.data() + (first - blockBegin), static_cast<int>(end - first)));
+        }
+        first = end;
+    }
+    return range;
+}
@@ -0,0 +1,108 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "MinMax.h"
+
+// 測定したデータの列をブロックごとに圧縮したもの
+// ブロックは前のブロックによらずに展開でき、目次に y の範囲を持っているので、
+// 見えている範囲のブロックだけを展開し、全体を見るときは目次だけで済ませられる
+//
+// ブロックの中身（ビット列、上の桁から詰める）
+//   x: 最初の値の 64 ビットのあと、ビット列を整数とみなした差の差（等間隔ならほぼ 0）を
+//      '0' = 0, '10' + 7 ビット, '110' + 12 ビット, '1110' + 20 ビット, '1111' + 64 ビット で書く
+//   y: 最初の値の 64 ビットのあと、前の値との XOR を
+//      '0' = 同じ値, '10' + 前と同じ幅の有効なビット, '11' + 先頭の 0 の数（5 ビット）+ 幅 - 1（6 ビット）+ 有効なビット で書く
+
+// 1 ブロックの点の数
+// 最小値・最大値の段のブロックの境界にそろうように、SummaryBaseBlock の SummaryFanout 乗の倍数にする
+// 全体を表示するときも列の両端のブロックは展開するので、目次が大きくなりすぎない範囲で小さくする
+const size_t SeriesBlockSize = 256;
+
+// 1 ブロックの目次
+// 隣のブロックとの間を補うときに展開しなくて済むように、両端の点も持っておく
+struct SeriesBlock {
+    // 圧縮したデータの先頭からの位置とバイト数
+    uint64_t offset;
+    uint32_t size;
+    // 点の数（最後のブロック以外は SeriesBlockSize）
+    uint32_t count;
+    double firstX;
+    double firstY;
+    double lastX;
+    double lastY;
+    // y の範囲（NaN と ±∞ は無視する）
+    MinMax range;
+};
+
+// 展開したブロック
+struct DecodedBlock {
+    std::vector<double> x;
+    std::vector<double> y;
+};
+
+// x, y の count 点をブロックごとに圧縮して data に書き、目次を blocks に入れる
+// ブロックは互いに関係しないので、スレッドに分けて圧縮する
+void CompressSeries(const double* x, const double* y, size_t count, std::vector<uint8_t>& data, std::vector<SeriesBlock>& blocks);
+
+// size バイトの data から count 点を x, y に展開する
+// data が壊れていても範囲の外は読まない（値がおかしくなるだけ）
+void DecompressBlock(const uint8_t* data, size_t size, size_t count, double* x, double* y);
+
+// storage が持っている圧縮した列
+// 展開したブロックは最近使ったものだけ覚えておく（描画のスレッドと先読みのスレッドの両方から使える）
+class CompressedSeries {
+public:
+    // blocks と data は storage の中を指す
+    // blocks は x の昇順で、size 点を SeriesBlockSize 点ずつ分けた数だけある
+    CompressedSeries(std::shared_ptr<const void> storage, const SeriesBlock* blocks, const uint8_t* data, size_t dataSize, size_t size);
+
+    size_t Size() const { return m_size; }
+    size_t BlockCount() const { return m_blockCount; }
+    const SeriesBlock& Block(size_t i) const { return m_blocks[i]; }
+
+    // i 番目のブロックを展開したもの
+    // 展開している間はロックを外すので、別のスレッドが先読みしていても待たされない
+    std::shared_ptr<const DecodedBlock> Decode(size_t i) const;
+
+    // x < x[i] となる最初の i（begin 以上）
+    // ブロックは目次の firstX で探すので、展開するのは 1 ブロックだけで済む
+    size_t IndexAfter(double x, size_t begin) const;
+
+    // x[index - 1] <= x < x[index] の間を直線で補う（index == Size() なら最後の点の値）
+    // ブロックの境目なら目次の両端の点を使う
+    double Interpolate(size_t index, double x) const;
+
+    // first 番目から last - 1 番目までの点の y の範囲
+    // 丸ごと含まれるブロックは目次の範囲を使い、端のブロックだけを展開する
+    MinMax ValueRange(size_t first, size_t last) const;
+
+private:
+    // i 番目のブロックの点の数
+    size_t BlockPoints(size_t i) const;
+
+    // 覚えておく展開したブロックの数
+    // 全体を表示したときに 1 画面で展開する分（列ごとに 1 ブロック程度）と、先読みした数画面分が入るようにする
+    static const size_t DecodedCacheSize = 8192;
+
+    typedef std::list<std::pair<size_t, std::shared_ptr<const DecodedBlock>>> CacheList;
+
+    std::shared_ptr<const void> m_storage;
+    const SeriesBlock* m_blocks;
+    size_t m_blockCount;
+    const uint8_t* m_data;
+    size_t m_dataSize;
+    size_t m_size;
+
+    mutable std::mutex m_cacheMutex;
+    // 最近使ったものほど前
+    mutable CacheList m_cache;
+    mutable std::unordered_map<size_t, CacheList::iterator> m_cacheIndex;
+};
@@ -0,0 +1,200 @@
+﻿#include "StreamingData.h"
+
+// C++ ライブラリ
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#include "SampledData.h"
+
+struct StreamingData::State {
+    // 以下は mutex で守る
+    std::mutex mutex;
+    std::vector<double> x;
+    std::vector<double> y;
+    // 段ごとのブロックの最小値・最大値（段 0 は SummaryBaseBlock 点ごと、その上は SummaryFanout ブロックごと）
+    // 最後のブロックは点が足されるたびに広げる
+    std::vector<std::vector<MinMax>> blocks;
+
+    std::atomic<uint64_t> revision;
+
+    State() : revision(0) {}
+};
+
+namespace {
+    typedef std::vector<std::vector<MinMax>> SummaryBlocks;
+
+    // index 番目の点 y を段に入れる
+    // 下の段が 2 ブロックになったら、それをまとめる段を上に足す
+    void AppendSummary(SummaryBlocks& blocks, size_t index, double y)
+    {
+        MinMax point = std::isfinite(y) ? MinMax{ y, y } : EmptyMinMax();
+        size_t blockSize = SummaryBaseBlock;
+
+        for (size_t level = 0; ; level++, blockSize *= SummaryFanout) {
+            if (level == blocks.size()) {
+                if (level > 0 && blocks[level - 1].size() < 2) break;
+                blocks.emplace_back();
+                if (level > 0) {
+                    // 新しい段の最初のブロックは下の段のすべてのブロック（今の点も入っている）をまとめたもの
+                    const std::vector<MinMax>& below = blocks[level - 1];
+                    blocks[level].push_back(CombineMinMax(below.data(), below.size()));
+                    continue;
+                }
+            }
+
+            std::vector<MinMax>& current = blocks[level];
+            size_t block = index / blockSize;
+            if (block == current.size()) current.push_back(EmptyMinMax());
+            current[block].Include(point);
+        }
+    }
+
+    // 段を SummaryValueRange に渡せる形にする（mutex を取ってから呼ぶ）
+    std::vector<SummaryLevel> MakeLevels(const SummaryBlocks& blocks)
+    {
+        std::vector<SummaryLevel> levels;
+        size_t blockSize = SummaryBaseBlock;
+        for (const std::vector<MinMax>& level : blocks) {
+            levels.push_back(SummaryLevel{ level.data(), level.size(), blockSize });
+            blockSize *= SummaryFanout;
+        }
+        return levels;
+    }
+
+    // x < x[i] となる最初の i（begin 以上）
+    size_t IndexAfter(const std::vector<double>& xs, double x, size_t begin)
+    {
+        const size_t LinearSearchLength = 8;
+        size_t end = std::min(begin + LinearSearchLength, xs.size());
+        for (size_t i = begin; i < end; i++) {
+            if (x < xs[i]) return i;
+        }
+        return std::upper_bound(xs.begin() + end, xs.end(), x) - xs.begin();
+    }
+
+    // xs[index - 1] <= x < xs[index] の間を直線で補う（index == size なら最後の点の値）
+    double Interpolate(const std::vector<double>& xs, const std::vector<double>& ys, size_t index, double x)
+    {
+        if (index >= xs.size()) return ys.back();
+        double x0 = xs[index - 1];
+        double y0 = ys[index - 1];
+        return y0 + (ys[index] - y0) * ((x - x0) / (xs[index] - x0));
+    }
+
+    // mutex を取ってから呼ぶ
+    double Evaluate(const std::vector<double>& xs, const std::vector<double>& ys, double x)
+    {
+        if (!(!xs.empty() && x >= xs.front() && x <= xs.back())) return std::numeric_limits<double>::quiet_NaN();
+        return Interpolate(xs, ys, IndexAfter(xs, x, 0), x);
+    }
+}
+
+StreamingData::StreamingData()
+    : m_state(std::make_shared<State>())
+{
+}
+
+void StreamingData::Append(double x, double y)
+{
+    State& s = *m_state;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!(s.x.empty() || x >= s.x.back())) return;
+
+        s.x.push_back(x);
+        s.y.push_back(y);
+        AppendSummary(s.blocks, s.x.size() - 1, y);
+    }
+    s.revision++;
+}
+
+uint64_t StreamingData::Revision() const
+{
+    return m_state->revision;
+}
+
+size_t StreamingData::Size() const
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    return m_state->x.size();
+}
+
+double StreamingData::operator()(double x) const
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    return Evaluate(m_state->x, m_state->y, x);
+}
+
+Interval StreamingData::operator()(const Interval& x) const
+{
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const State& s = *m_state;
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+
+    if (s.x.empty() || x.hi < s.x.front() || x.lo > s.x.back()) return Interval(nan, nan);
+
+    double lo = std::max(x.lo, s.x.front());
+    double hi = std::min(x.hi, s.x.back());
+    size_t first = IndexAfter(s.x, lo, 0);
+    size_t last = IndexAfter(s.x, hi, first);
+
+    // first から last - 1 までの点は lo < x <= hi の範囲にある
+    double ends[] = { Evaluate(s.x, s.y, lo), Evaluate(s.x, s.y, hi) };
+    MinMax range = ComputeMinMax(ends, 2);
+    range.Include(SummaryValueRange(MakeLevels(s.blocks), first, last, [&s](size_t begin, size_t end) {
+        return ComputeMinMax(s.y.data() + begin, static_cast<int>(end - begin));
+    }));
+
+    if (std::isnan(ends[0]) || std::isnan(ends[1]) || range.IsEmpty()) return Interval(nan, nan);
+    return Interval(range.min, range.max);
+}
+
+void StreamingData::Sample(double x0, double dx, int count, double* values) const
+{
+    const State& s = *m_state;
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+
+    size_t index = 0;
+    for (int i = 0; i < count; i++) {
+        double x = x0 + dx * i;
+        if (!(!s.x.empty() && x >= s.x.front() && x <= s.x.back())) {
+            values[i] = std::numeric_limits<double>::quiet_NaN();
+            continue;
+        }
+        index = IndexAfter(s.x, x, index);
+        values[i] = Interpolate(s.x, s.y, index, x);
+    }
+}
+
+void StreamingData::Query(double xmin, double xmax, int desiredPoints, DataSpan& span) const
+{
+    const State& s = *m_state;
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+
+    span.Clear();
+    if (s.x.empty() || desiredPoints <= 0 || !(xmin < xmax) || xmax < s.x.front() || xmin >= s.x.back()) return;
+
+    size_t first = IndexAfter(s.x, xmin, 0);
+    size_t last = IndexAfter(s.x, xmax, first);
+
+    if (last - first <= static_cast<size_t>(desiredPoints)) {
+        for (size_t i = first; i < last; i++) {
+            span.Push(s.x[i], s.y[i], s.y[i]);
+        }
+        return;
+    }
+
+    std::vector<SummaryLevel> levels = MakeLevels(s.blocks);
+    DecimateRange(first, last, xmin, xmax, desiredPoints,
+        [&s](double x, size_t begin) { return IndexAfter(s.x, x, begin); },
+        [&s, &levels](size_t begin, size_t end) {
+            return SummaryValueRange(levels, begin, end, [&s](size_t a, size_t b) {
+                return ComputeMinMax(s.y.data() + a, static_cast<int>(b - a));
+            });
+        },
+        span);
+}
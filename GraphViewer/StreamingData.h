@@ -0,0 +1,42 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "DataSource.h"
+#include "Interval.h"
+
+// 別のスレッドから点を足していくデータ（計測中の値など）
+// SampledData と同じく点を線でつなぎ、データの範囲の外と欠けた点の前後は NaN になる
+// 点を足すたびに最小値・最大値の段も更新するので、点が増えても列ごとの範囲は点の数によらずに求まる
+// コピーしても同じ点の列を共有する
+class StreamingData {
+public:
+    StreamingData();
+
+    // 点を 1 つ足す
+    // x は前の点以上にする（小さければ捨てる）
+    void Append(double x, double y);
+
+    // 点を足すたびに増える番号
+    uint64_t Revision() const;
+
+    size_t Size() const;
+
+    double operator()(double x) const;
+
+    // x の範囲で線が取る値の範囲（SampledData と同じ）
+    Interval operator()(const Interval& x) const;
+
+    // x0 + dx * i (0 <= i < count) での値を values に書き込む（dx > 0）
+    // 点を足しているスレッドは、書き込み終わるまで待たされる
+    void Sample(double x0, double dx, int count, double* values) const;
+
+    // xmin < x <= xmax の点を desiredPoints 列以下にまとめて span に入れる（DataSource::Query）
+    void Query(double xmin, double xmax, int desiredPoints, DataSpan& span) const;
+
+private:
+    struct State;
+    std::shared_ptr<State> m_state;
+};
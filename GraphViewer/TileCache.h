@@ -0,0 +1,137 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+// タイルの幅（px）
+// タイルは画面の高さいっぱいの縦長の短冊
+const int TileWidth = 256;
+
+// タイルを識別するキー
+struct TileKey {
+    // ズーム段階
+    int zoomLevel;
+    // x 方向の位置（ズーム段階ごとの px 座標 / TileWidth）
+    int64_t index;
+
+    bool operator==(const TileKey& other) const
+    {
+        return zoomLevel == other.zoomLevel && index == other.index;
+    }
+};
+
+struct TileKeyHash {
+    size_t operator()(const TileKey& key) const
+    {
+        return std::hash<int64_t>()(key.index * 64 + key.zoomLevel);
+    }
+};
+
+// ズーム段階ごとの px 座標 pixel を含むタイルの番号
+inline int64_t TileIndexOf(int64_t pixel)
+{
+    // 負の座標でも切り捨てになるようにする
+    return pixel >= 0 ? pixel / TileWidth : -((-pixel + TileWidth - 1) / TileWidth);
+}
+
+// 描いたタイルを覚えておくキャッシュ
+// 合計サイズが上限を超えたら、使われていない期間が一番長いものから捨てる
+// Surface はタイルごとに覚えておくもの（描いた画像や計算した値）で、捨てるときに release が呼ばれる
+template<class Surface>
+class TileCache {
+public:
+    typedef std::function<void(Surface&)> Releaser;
+
+    TileCache(size_t budgetBytes, Releaser release)
+        : m_budgetBytes(budgetBytes),
+        m_usedBytes(0),
+        m_release(release)
+    {
+    }
+
+    ~TileCache()
+    {
+        Clear();
+    }
+
+    TileCache(const TileCache&) = delete;
+    TileCache& operator=(const TileCache&) = delete;
+
+    // 見つかったら最近使ったことにして返す。なければ nullptr
+    Surface* Find(const TileKey& key)
+    {
+        auto it = m_index.find(key);
+        if (it == m_index.end()) return nullptr;
+
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return &it->second->surface;
+    }
+
+    // あるかどうかだけ調べる（最近使ったことにはしない）
+    bool Contains(const TileKey& key) const
+    {
+        return m_index.find(key) != m_index.end();
+    }
+
+    // 追加する
+    // 描画中のタイルを捨てないように、ここでは上限を超えても捨てない。フレームの最後に Trim を呼ぶ
+    void Insert(const TileKey& key, Surface surface, size_t bytes)
+    {
+        auto it = m_index.find(key);
+        if (it != m_index.end()) {
+            Remove(it->second);
+        }
+
+        m_entries.push_front(Entry{ key, std::move(surface), bytes });
+        m_index[key] = m_entries.begin();
+        m_usedBytes += bytes;
+    }
+
+    // 上限に収まるまで古いものを捨てる
+    void Trim()
+    {
+        while (m_usedBytes > m_budgetBytes && !m_entries.empty()) {
+            Remove(std::prev(m_entries.end()));
+        }
+    }
+
+    // 全部捨てる
+    void Clear()
+    {
+        while (!m_entries.empty()) {
+            Remove(m_entries.begin());
+        }
+    }
+
+    size_t UsedBytes() const { return m_usedBytes; }
+
+private:
+    struct Entry {
+        TileKey key;
+        Surface surface;
+        size_t bytes;
+    };
+
+    typedef typename std::list<Entry>::iterator EntryIterator;
+
+    void Remove(EntryIterator it)
+    {
+        m_release(it->surface);
+        m_usedBytes -= it->bytes;
+        m_index.erase(it->key);
+        m_entries.erase(it);
+    }
+
+    size_t m_budgetBytes;
+    size_t m_usedBytes;
+    Releaser m_release;
+
+    // 先頭ほど最近使ったもの
+    std::list<Entry> m_entries;
+    std::unordered_map<TileKey, EntryIterator, TileKeyHash> m_index;
+};
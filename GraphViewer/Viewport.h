@@ -0,0 +1,146 @@
+﻿#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "DoubleDouble.h"
+
+// 画面上の座標と関数の座標を相互に変換する
+// フレームごとに 1 回だけ作り、サンプリングと描画で同じものを使う
+// 割り算は作るときに済ませておき、点ごとの変換は積和 1 回で済むようにする
+struct ViewportTransform {
+    // 関数の x = 画面の x * scaleX + offsetX
+    double scaleX;
+    double offsetX;
+    // offsetX を丸めずに持ったもの
+    // 深くズームすると offsetX の丸め誤差が 1px の幅より大きくなるので、そのときはこちらを使う
+    DoubleDouble originX;
+    // 画面の y = 関数の値 * scaleY + offsetY
+    double scaleY;
+    double offsetY;
+
+    double ToDomainX(double screenX) const
+    {
+        return screenX * scaleX + offsetX;
+    }
+
+    // ToDomainX と同じだが、原点からのずれを丸めずに足す
+    DoubleDouble ToDomainXDeep(double screenX) const
+    {
+        return originX + screenX * scaleX;
+    }
+
+    float ToScreenY(double value) const
+    {
+        return static_cast<float>(value * scaleY + offsetY);
+    }
+
+    // 関数の値をまとめて画面の y 座標にする
+    void ToScreenY(const double* values, int count, float* screenY) const
+    {
+        const double a = scaleY;
+        const double b = offsetY;
+        for (int i = 0; i < count; i++) {
+            screenY[i] = static_cast<float>(values[i] * a + b);
+        }
+    }
+};
+
+// ホイール 1 段あたりのズーム段階の数（1 段で 2 の 1/4 乗倍）
+const int ZoomStepsPerOctave = 4;
+
+// ズームしてよい左端の px 座標の大きさの上限（int64_t があふれないように 2^62）
+// 1px の幅は x の大きさの 2^-62 倍まで小さくでき、double（2^-52 倍）より細かく見られる
+const double MaxOriginPixel = 4611686018427387904.0;
+
+// パン・ズームで動かす表示範囲
+// x 方向はズーム段階ごとに 1px あたりの幅を決めて、左端をその px 単位の整数で持つ
+// こうしておくと同じズーム段階ならパンしても px の境界がずれないので、描いたものを使い回せる
+// 左端の関数の x は px 座標と 1px の幅の積を DoubleDouble で求めるので、double の精度より深くズームしても丸められない
+struct Viewport {
+    // ズーム段階 0 での 1px あたりの x の幅
+    double baseUnitsPerPixel;
+    // ズーム段階（大きいほど拡大）
+    int zoomLevel;
+    // 画面の左端（ズーム段階ごとの px 単位）
+    int64_t originPixel;
+    // y 軸の下
+    double startY;
+    // y 軸の上
+    double endY;
+
+    double UnitsPerPixel() const
+    {
+        return UnitsPerPixel(zoomLevel);
+    }
+
+    // ズーム段階 level での 1px あたりの x の幅
+    double UnitsPerPixel(int level) const
+    {
+        return baseUnitsPerPixel * std::exp2(-level / static_cast<double>(ZoomStepsPerOctave));
+    }
+
+    // firstPixel（ズーム段階ごとの px 単位）が描画先の x = 0 になる変換
+    ViewportTransform Transform(int64_t firstPixel, double height) const
+    {
+        ViewportTransform t;
+        t.scaleX = UnitsPerPixel();
+        t.originX = MakeDoubleDouble(firstPixel) * t.scaleX;
+        t.offsetX = t.originX.hi;
+        t.scaleY = -height / (endY - startY);
+        t.offsetY = height - startY * t.scaleY;
+        return t;
+    }
+
+    // 画面の左端が描画先の x = 0 になる変換
+    ViewportTransform Transform(double height) const
+    {
+        return Transform(originPixel, height);
+    }
+
+    // 画面上の anchorX の位置を動かさずに steps 段ズームする
+    // 左端の px 座標が MaxOriginPixel を超えるほど拡大するときは何もしない
+    void Zoom(int steps, double anchorX)
+    {
+        DoubleDouble anchor = (MakeDoubleDouble(originPixel) + anchorX) * UnitsPerPixel();
+        DoubleDouble origin = anchor / UnitsPerPixel(zoomLevel + steps) - anchorX;
+        if (!(std::fabs(origin.hi) <= MaxOriginPixel)) return;
+
+        zoomLevel += steps;
+        originPixel = RoundToInt64(origin);
+    }
+
+    // 画面の幅が変わっても同じ x の範囲が見えるようにする
+    void Resize(double oldWidth, double newWidth)
+    {
+        if (oldWidth <= 0 || newWidth <= 0) return;
+        DoubleDouble left = MakeDoubleDouble(originPixel) * UnitsPerPixel();
+        baseUnitsPerPixel *= oldWidth / newWidth;
+        originPixel = RoundToInt64(left / UnitsPerPixel());
+    }
+};
+
+// 最初に表示する範囲（Home キーでここに戻る）
+// 描くデータ（DataSource）とは別に決める
+struct ViewRange {
+    // x 軸の左端
+    double startX;
+    // x 軸の右端
+    double endX;
+    // y 軸の下
+    double startY;
+    // y 軸の上
+    double endY;
+};
+
+// range.startX..endX が幅 width にちょうど収まる Viewport を作る
+inline Viewport FitViewport(const ViewRange& range, double width)
+{
+    Viewport v;
+    v.baseUnitsPerPixel = (range.endX - range.startX) / (width > 0 ? width : 1.0);
+    v.zoomLevel = 0;
+    v.originPixel = std::llround(range.startX / v.baseUnitsPerPixel);
+    v.startY = range.startY;
+    v.endY = range.endY;
+    return v;
+}
@@ -0,0 +1,19 @@
+﻿#pragma once
+
+// 画面を使わずに確かめられる部分の確認
+// それぞれ失敗した数を返し、失敗の内容は標準エラーに書く
+
+// 近似関数の誤差が、倍精度の全範囲で FastMathMaxError 以下であること
+// FastDouble で評価して範囲の外の点を計算し直したときも同じ
+int CheckFastMath();
+
+// 最適化した式が、どの x でも書いたとおりに計算したのと同じ値になること
+// 近似関数用の命令列では exp(k + p) = exp(k) * exp(p) で exp がまとまり、誤差が FastMathValueError 以内であること
+int CheckFormulaOptimization();
+
+// 画像の外を通る線で、SoftwareCanvas が画像や作業用の配列の外に書かないこと
+// 帯を複数のスレッドで手分けして塗っても、スレッドの数によらず同じ画素になること
+int CheckSoftwareCanvas();
+
+// GraphRenderer で SoftwareCanvas に描いた画素が、描いた関数やデータから決まる画素になること
+int CheckGraphRenderer();
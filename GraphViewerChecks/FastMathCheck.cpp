@@ -0,0 +1,171 @@
+﻿#include "Checks.h"
+
+// C++ ライブラリ
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "FastMath.h"
+#include "Sampler.h"
+
+namespace {
+    // 1 つの指数（2 の累乗の区間）から取る点の数
+    const int SamplesPerExponent = 64;
+
+    // 正の倍精度の全範囲（非正規化数から最大値まで）を、指数ごとに等間隔に取った点
+    // 等間隔に取ると、log の小さな引数や exp の大きな負の引数を調べられない
+    std::vector<double> PositiveInputs()
+    {
+        std::vector<double> inputs;
+        for (int exponent = -1074; exponent <= 1023; exponent++) {
+            for (int i = 0; i < SamplesPerExponent; i++) {
+                double x = std::ldexp(1 + static_cast<double>(i) / SamplesPerExponent, exponent);
+                if (std::isfinite(x)) inputs.push_back(x);
+            }
+        }
+        inputs.push_back(std::numeric_limits<double>::infinity());
+        return inputs;
+    }
+
+    // 近似の値が 0 や無限大や NaN なら、標準の関数と同じでなければならない
+    bool IsSpecial(double exact)
+    {
+        return exact == 0 || !std::isfinite(exact);
+    }
+
+    double RelativeError(double approx, double exact)
+    {
+        if (IsSpecial(exact)) {
+            bool same = approx == exact || (std::isnan(approx) && std::isnan(exact));
+            return same ? 0 : std::numeric_limits<double>::infinity();
+        }
+        return std::fabs(approx - exact) / std::fabs(exact);
+    }
+
+    double AbsoluteError(double approx, double exact)
+    {
+        if (!std::isfinite(exact)) return RelativeError(approx, exact);
+        return std::fabs(approx - exact);
+    }
+
+    // approx(x, y, count) で計算した y[i] と exact(x[i]) の誤差の最大が FastMathMaxError を超えたら書き出す
+    template<class Approx, class Exact, class Error>
+    int CheckFunction(const char* name, const char* kind, Approx approx, Exact exact, Error error, const std::vector<double>& x)
+    {
+        std::vector<double> y(x.size());
+        approx(x.data(), y.data(), static_cast<int>(x.size()));
+
+        double worst = 0;
+        double worstX = 0;
+        for (size_t i = 0; i < x.size(); i++) {
+            double e = error(y[i], exact(x[i]));
+            // NaN の誤差は最悪として残す（NaN とは比べられないので、後の点で上書きしない）
+            if (!std::isnan(worst) && !(e <= worst)) {
+                worst = e;
+                worstX = x[i];
+            }
+        }
+
+        if (!(worst <= FastMathMaxError)) {
+            std::fprintf(stderr, "FastMath: %s %s error %g at x = %.17g exceeds %g\n", name, kind, worst, worstX, FastMathMaxError);
+            return 1;
+        }
+        return 0;
+    }
+
+    // inputs に符号を変えた点を足す
+    std::vector<double> WithNegatives(const std::vector<double>& inputs)
+    {
+        std::vector<double> result = inputs;
+        for (double x : inputs) {
+            result.push_back(-x);
+        }
+        return result;
+    }
+
+    // 近似できる範囲の内と外にまたがる x を、SampleFunctionFast と SampleFunctionSlope<FastDual> で評価する
+    // 範囲の外の点は NaN になってから計算し直されるので、近似関数を直接呼んだときと同じ誤差に収まらなければならない
+    template<class F, class Exact, class Error>
+    int CheckSampled(const char* name, const char* kind, const F& func, Exact exact, Error error, double x0, double x1)
+    {
+        const int count = 4096;
+        double dx = (x1 - x0) / count;
+
+        std::vector<double> values(count);
+        std::vector<double> slopes(count);
+        std::vector<double> slopeValues(count);
+        SampleFunctionFast(func, x0, dx, count, values.data());
+        SampleFunctionSlope<FastDual>(func, x0, dx, count, slopeValues.data(), slopes.data());
+
+        double worst = 0;
+        double worstX = 0;
+        for (int i = 0; i < count; i++) {
+            double x = x0 + dx * i;
+            double e = std::max(error(values[i], exact(x)), error(slopeValues[i], exact(x)));
+            // NaN の誤差は最悪として残す（NaN とは比べられないので、後の点で上書きしない）
+            if (!std::isnan(worst) && !(e <= worst)) {
+                worst = e;
+                worstX = x;
+            }
+        }
+
+        if (!(worst <= FastMathMaxError)) {
+            std::fprintf(stderr, "FastMath: sampled %s %s error %g at x = %.17g exceeds %g\n", name, kind, worst, worstX, FastMathMaxError);
+            return 1;
+        }
+        return 0;
+    }
+}
+
+int CheckFastMath()
+{
+    std::vector<double> inputs = PositiveInputs();
+    std::vector<double> withNaN = inputs;
+    withNaN.push_back(std::numeric_limits<double>::quiet_NaN());
+
+    auto fastExp = [](const double* x, double* y, int count) { FastExp(x, y, count); };
+    auto fastLog = [](const double* x, double* y, int count) { FastLog(x, y, count); };
+    auto fastSin = [](const double* x, double* y, int count) { FastSin(x, y, count); };
+    auto fastCos = [](const double* x, double* y, int count) { FastCos(x, y, count); };
+    auto exactExp = [](double x) { return std::exp(x); };
+    auto exactLog = [](double x) { return std::log(x); };
+    auto exactSin = [](double x) { return std::sin(x); };
+    auto exactCos = [](double x) { return std::cos(x); };
+
+    // 0 以下の log は標準の関数に任せているので、log だけは正の数で調べる
+    std::vector<double> withZero = withNaN;
+    withZero.push_back(0);
+    std::vector<double> signedInputs = WithNegatives(withZero);
+
+    int failures = 0;
+    failures += CheckFunction("FastExp", "relative", fastExp, exactExp, RelativeError, signedInputs);
+    failures += CheckFunction("FastLog", "relative", fastLog, exactLog, RelativeError, withNaN);
+    failures += CheckFunction("FastSin", "absolute", fastSin, exactSin, AbsoluteError, signedInputs);
+    failures += CheckFunction("FastCos", "absolute", fastCos, exactCos, AbsoluteError, signedInputs);
+
+    // FastDouble で評価したときは、範囲の外の点を評価した後で計算し直す
+    auto sampledExp = [](auto x) { return exp(x); };
+    auto sampledLog = [](auto x) { return log(x); };
+    auto sampledSin = [](auto x) { return sin(x); };
+    auto sampledCos = [](auto x) { return cos(x); };
+    failures += CheckSampled("exp", "relative", sampledExp, exactExp, RelativeError, -1000, 1000);
+    failures += CheckSampled("log", "relative", sampledLog, exactLog, RelativeError, -1, 1);
+    failures += CheckSampled("sin", "absolute", sampledSin, exactSin, AbsoluteError, -3 * FastMathMaxTrigArgument, 3 * FastMathMaxTrigArgument);
+    failures += CheckSampled("cos", "absolute", sampledCos, exactCos, AbsoluteError, -3 * FastMathMaxTrigArgument, 3 * FastMathMaxTrigArgument);
+
+    // 実行時に読み込んだ式は、命令ごとに FastExp などでまとめて計算する
+    CompiledFormula formulaExp, formulaLog, formulaSin, formulaCos;
+    std::string error;
+    CompileFormula("exp(x)", formulaExp, error);
+    CompileFormula("log(x)", formulaLog, error);
+    CompileFormula("sin(x)", formulaSin, error);
+    CompileFormula("cos(x)", formulaCos, error);
+    failures += CheckSampled("formula exp", "relative", formulaExp, exactExp, RelativeError, -1000, 1000);
+    failures += CheckSampled("formula log", "relative", formulaLog, exactLog, RelativeError, -1, 1);
+    failures += CheckSampled("formula sin", "absolute", formulaSin, exactSin, AbsoluteError, -3 * FastMathMaxTrigArgument, 3 * FastMathMaxTrigArgument);
+    failures += CheckSampled("formula cos", "absolute", formulaCos, exactCos, AbsoluteError, -3 * FastMathMaxTrigArgument, 3 * FastMathMaxTrigArgument);
+    return failures;
+}
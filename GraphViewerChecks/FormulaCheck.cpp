@@ -0,0 +1,175 @@
+﻿#include "Checks.h"
+
+// C++ ライブラリ
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "Formula.h"
+#include "Sampler.h"
+
+namespace {
+    // 最適化で書き換えられる形を含む式
+    const char* const Formulas[] = {
+        "exp(-64 + x)",
+        "exp(64 + x)",
+        "exp(-2 * t) + exp(-2 * (t - 3))",
+        "3 * (2 + x)",
+        "2 * (3 * x)",
+        "1 + (2 + x)",
+        "2 * x + 3 * x",
+        "2 * x - 3 * x",
+        "x + 0",
+        "x - 0",
+        "0 - x",
+        "-(2 * x)",
+        "-(-x)",
+        "2 * -x",
+        "-1 * x",
+        "x * 1",
+        "x / 4",
+        "x / 3",
+        "x / 1",
+        "sin(x) * exp(-x * x / 10) + log(x + 20)",
+        "sqrt(abs(x)) / (x * x + 1) - cos(3 * x) + exp(sin(x)) * exp(sin(x))",
+    };
+
+    // 近似関数で計算するときに exp を 1 回にまとめられる式（ステップ応答 v のそれぞれの区間）
+    const char* const SharedExpFormulas[] = {
+        "1 - exp(-2 * t)",
+        "-exp(-2 * t) + exp(-2 * (t - 3))",
+        "exp(x) + exp(x + 1)",
+    };
+
+    // 倍精度の全範囲から、指数ごとに取った点（非正規化数、±0、±∞、NaN を含む）
+    std::vector<double> Inputs()
+    {
+        std::vector<double> inputs = {
+            0.0, -0.0,
+            std::numeric_limits<double>::infinity(),
+            -std::numeric_limits<double>::infinity(),
+            std::numeric_limits<double>::quiet_NaN(),
+        };
+        for (int exponent = -1074; exponent <= 1023; exponent++) {
+            for (double mantissa : { 1.0, 1.6180339887498949 }) {
+                double x = std::ldexp(mantissa, exponent);
+                inputs.push_back(x);
+                inputs.push_back(-x);
+            }
+        }
+        return inputs;
+    }
+
+    // ビットまで同じか（NaN どうしは、符号や中身によらず同じとみなす）
+    bool SameValue(double a, double b)
+    {
+        if (std::isnan(a) && std::isnan(b)) return true;
+        uint64_t bitsA, bitsB;
+        std::memcpy(&bitsA, &a, sizeof(bitsA));
+        std::memcpy(&bitsB, &b, sizeof(bitsB));
+        return bitsA == bitsB;
+    }
+
+    // 最適化した命令列と、書いたとおりの命令列で、同じ値になるか
+    int CheckFormula(const char* text, const std::vector<double>& inputs)
+    {
+        CompiledFormula optimized, direct;
+        std::string error;
+        if (!CompileFormula(text, optimized, error) || !CompileFormula(text, direct, error, false)) {
+            std::fprintf(stderr, "Formula: %s: %s\n", text, error.c_str());
+            return 1;
+        }
+
+        for (double x : inputs) {
+            double expected = direct(x);
+            double actual = optimized(x);
+            double expectedSample, actualSample;
+            direct.Sample(x, 0, 1, &expectedSample);
+            optimized.Sample(x, 0, 1, &actualSample);
+
+            if (!SameValue(expected, actual) || !SameValue(expectedSample, actualSample)) {
+                std::fprintf(stderr, "Formula: %s at x = %.17g: optimized %.17g, direct %.17g\n",
+                    text, x, SameValue(expected, actual) ? actualSample : actual, SameValue(expected, actual) ? expectedSample : expected);
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    // 近似関数用の命令列で exp が 1 回になり、値が FastMathValueError 以内に収まるか
+    // 値は、書き換えであふれたり 0 になったりしない範囲で比べる
+    int CheckSharedExp(const char* text)
+    {
+        CompiledFormula formula, direct;
+        std::string error;
+        if (!CompileFormula(text, formula, error) || !CompileFormula(text, direct, error, false)) {
+            std::fprintf(stderr, "Formula: %s: %s\n", text, error.c_str());
+            return 1;
+        }
+
+        if (formula.FastTranscendentalCount() != 1) {
+            std::fprintf(stderr, "Formula: %s calls %zu transcendental functions per point in fast mode, expected 1\n",
+                text, formula.FastTranscendentalCount());
+            return 1;
+        }
+
+        const int count = 1000;
+        const double x0 = -20;
+        const double dx = 0.04;
+        std::vector<double> values(count);
+        SampleFunctionFast(formula, x0, dx, count, values.data());
+        for (int i = 0; i < count; i++) {
+            double expected = direct(x0 + dx * i);
+            if (!(std::fabs(values[i] - expected) <= FastMathValueError(std::fabs(expected)))) {
+                std::fprintf(stderr, "Formula: %s at x = %.17g: fast %.17g, direct %.17g\n", text, x0 + dx * i, values[i], expected);
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    // exp(-64) * exp(x) は x が 709.8 を超えるとあふれるが、書いたとおりなら 773.8 まであふれない
+    // その間の点は計算し直されて、有限の値になるか
+    int CheckFastOverflow()
+    {
+        const char* text = "exp(-64 + x)";
+        CompiledFormula formula;
+        std::string error;
+        if (!CompileFormula(text, formula, error)) {
+            std::fprintf(stderr, "Formula: %s: %s\n", text, error.c_str());
+            return 1;
+        }
+
+        const int count = 100;
+        const double x0 = 700;
+        const double dx = 0.5;
+        std::vector<double> values(count);
+        SampleFunctionFast(formula, x0, dx, count, values.data());
+        for (int i = 0; i < count; i++) {
+            double expected = formula(x0 + dx * i);
+            if (!(std::fabs(values[i] - expected) <= FastMathValueError(std::fabs(expected)))) {
+                std::fprintf(stderr, "Formula: %s at x = %.17g: fast %.17g, direct %.17g\n", text, x0 + dx * i, values[i], expected);
+                return 1;
+            }
+        }
+        return 0;
+    }
+}
+
+int CheckFormulaOptimization()
+{
+    std::vector<double> inputs = Inputs();
+    int failures = 0;
+    for (const char* text : Formulas) {
+        failures += CheckFormula(text, inputs);
+    }
+    for (const char* text : SharedExpFormulas) {
+        failures += CheckSharedExp(text);
+    }
+    failures += CheckFastOverflow();
+    return failures;
+}
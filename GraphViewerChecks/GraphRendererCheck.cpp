@@ -0,0 +1,126 @@
+﻿#include "Checks.h"
+
+// C++ ライブラリ
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "GraphRenderer.h"
+#include "SoftwareCanvas.h"
+
+namespace {
+    const int CanvasWidth = 320;
+    const int CanvasHeight = 200;
+
+    // 描画先のスレッドの数（帯を手分けして塗るかどうかで結果が変わらないことも確かめる）
+    const int ThreadCounts[] = { 1, 4 };
+
+    // GraphRenderer が塗る色（GraphRenderer.cpp の BackgroundColor, GraphLineColor と同じ）
+    const uint32_t BackgroundPixel = 0xFFFFFFFF;
+    const uint32_t GraphLinePixel = 0xFFFF0000;
+
+    // x が -4 から 4、y が -1 から 1 の範囲
+    const ViewRange Range = { -4, 4, -1, 1 };
+
+    // sampler を threadCount 個のスレッドの SoftwareCanvas に描いた画素
+    std::vector<uint32_t> Render(std::unique_ptr<GraphSampler> sampler, EvaluationPrecision precision, int threadCount)
+    {
+        GraphRenderer renderer(std::move(sampler));
+        renderer.SetPrecision(precision);
+
+        SoftwareCanvas canvas(CanvasWidth, CanvasHeight, threadCount);
+        Viewport viewport = FitViewport(Range, CanvasWidth);
+        renderer.BeginFrame(CanvasWidth);
+        renderer.Render(canvas, viewport.Transform(CanvasHeight), CanvasWidth, CanvasHeight);
+        return std::vector<uint32_t>(canvas.Pixels(), canvas.Pixels() + CanvasWidth * CanvasHeight);
+    }
+
+    // y = 0 の線は画面の y = 100 を中心とする幅 2px の横線になり、
+    // 99 行目と 100 行目がちょうど線の色で、ほかはすべて背景の色になる
+    int CheckFlatLine(const char* name, std::unique_ptr<GraphSampler> (*create)(), EvaluationPrecision precision)
+    {
+        int failures = 0;
+        for (int threadCount : ThreadCounts) {
+            std::vector<uint32_t> pixels = Render(create(), precision, threadCount);
+            for (int i = 0; i < CanvasWidth * CanvasHeight; i++) {
+                int y = i / CanvasWidth;
+                uint32_t expected = y == CanvasHeight / 2 - 1 || y == CanvasHeight / 2 ? GraphLinePixel : BackgroundPixel;
+                if (pixels[i] != expected) {
+                    std::fprintf(stderr, "GraphRenderer: %s (%d threads) pixel (%d, %d) is %08X, expected %08X\n",
+                        name, threadCount, i % CanvasWidth, y, pixels[i], expected);
+                    failures++;
+                    break;
+                }
+            }
+        }
+        return failures;
+    }
+
+    std::unique_ptr<GraphSampler> CreateZeroFunction()
+    {
+        return CreateGraphSampler([](auto x) { return decltype(x)(0); });
+    }
+
+    std::unique_ptr<GraphSampler> CreateZeroData()
+    {
+        return CreateGraphSampler(SampledData({ -10.0, 10.0 }, { 0.0, 0.0 }));
+    }
+
+    std::unique_ptr<GraphSampler> CreateSine()
+    {
+        return CreateGraphSampler([](auto x) { return 0.8 * sin(x); });
+    }
+
+    // 曲線の線は、列ごとに曲線が通る行の近くだけを塗る
+    // 列 x の中心での y（画面）の行は線の色に塗られ、列の両端での y から線の太さより離れた行は背景の色のまま
+    int CheckSine(EvaluationPrecision precision)
+    {
+        const char* name = precision == EvaluationPrecision::Fast ? "sine (fast)" : "sine";
+
+        Viewport viewport = FitViewport(Range, CanvasWidth);
+        ViewportTransform transform = viewport.Transform(CanvasHeight);
+        auto screenY = [&](double x) { return 0.8 * std::sin(transform.ToDomainX(x)) * transform.scaleY + transform.offsetY; };
+
+        int failures = 0;
+        for (int threadCount : ThreadCounts) {
+            std::vector<uint32_t> pixels = Render(CreateSine(), precision, threadCount);
+            for (int x = 0; x < CanvasWidth && failures == 0; x++) {
+                double left = screenY(x);
+                double right = screenY(x + 1);
+                // 傾いた線の太さの半分を縦に測った長さと、アンチエイリアスで隣の画素にかかる分
+                double margin = std::sqrt(1 + (right - left) * (right - left)) + 1;
+                double top = std::min(left, right) - margin;
+                double bottom = std::max(left, right) + margin;
+
+                int center = static_cast<int>(std::floor(screenY(x + 0.5)));
+                if (pixels[center * CanvasWidth + x] == BackgroundPixel) {
+                    std::fprintf(stderr, "GraphRenderer: %s (%d threads) column %d is unpainted at row %d\n", name, threadCount, x, center);
+                    failures++;
+                }
+
+                for (int y = 0; y < CanvasHeight && failures == 0; y++) {
+                    bool near = y + 1 > top && y < bottom;
+                    if (!near && pixels[y * CanvasWidth + x] != BackgroundPixel) {
+                        std::fprintf(stderr, "GraphRenderer: %s (%d threads) painted pixel (%d, %d) away from the curve\n", name, threadCount, x, y);
+                        failures++;
+                    }
+                }
+            }
+        }
+        return failures;
+    }
+}
+
+int CheckGraphRenderer()
+{
+    int failures = 0;
+    failures += CheckFlatLine("zero function", CreateZeroFunction, EvaluationPrecision::Exact);
+    failures += CheckFlatLine("zero function (fast)", CreateZeroFunction, EvaluationPrecision::Fast);
+    failures += CheckFlatLine("zero data", CreateZeroData, EvaluationPrecision::Exact);
+    failures += CheckSine(EvaluationPrecision::Exact);
+    failures += CheckSine(EvaluationPrecision::Fast);
+    return failures;
+}
@@ -0,0 +1,22 @@
+﻿#include "Checks.h"
+
+// C++ ライブラリ
+#include <cstdio>
+
+// 失敗があれば 0 以外で終わるので、ビルドの後に実行して確かめる
+int main()
+{
+    int failures = 0;
+    failures += CheckFastMath();
+    failures += CheckFormulaOptimization();
+    failures += CheckSoftwareCanvas();
+    failures += CheckGraphRenderer();
+
+    if (failures != 0) {
+        std::printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+
+    std::printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,157 @@
+﻿#include "Checks.h"
+
+// C++ ライブラリ
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "SoftwareCanvas.h"
+
+namespace {
+    const int CanvasSize = 256;
+
+    const GraphColor Background = { 1, 1, 1, 1 };
+    const GraphColor Stroke = { 0, 0, 0, 1 };
+
+    struct Line {
+        const char* name;
+        float x0;
+        float y0;
+        float x1;
+        float y1;
+        float strokeWidth;
+    };
+
+    // 左右の端を横切ってから上下の外に出る線
+    // 端で分けた後の部分が上下の外に残り、以前は帯の配列の外に書いていた
+    // （Debug ビルドの配列の範囲の確認か、AddressSanitizer で見つかる）
+    const Line OutsideLines[] = {
+        { "left edge below", -10, 400, 10, 300, 2 },
+        { "right edge below", 250, 300, 270, 260, 2 },
+        { "left edge above", -10, -50, 10, -5, 2 },
+        { "right edge above", 250, -40, 266, -4, 3 },
+        { "both edges below", -20, 300, 280, 270, 2 },
+    };
+
+    // 画像の外を通る線は 1 画素も変えない
+    int CheckOutsideLine(const Line& line, int threadCount)
+    {
+        SoftwareCanvas canvas(CanvasSize, CanvasSize, threadCount);
+        canvas.Clear(Background);
+        std::vector<uint32_t> before(canvas.Pixels(), canvas.Pixels() + CanvasSize * CanvasSize);
+
+        float xs[] = { line.x0, line.x1 };
+        float ys[] = { line.y0, line.y1 };
+        canvas.DrawPolyline(xs, ys, 2, Stroke, line.strokeWidth);
+
+        for (int i = 0; i < CanvasSize * CanvasSize; i++) {
+            if (canvas.Pixels()[i] != before[i]) {
+                std::fprintf(stderr, "SoftwareCanvas: %s (%d threads) changed pixel (%d, %d)\n",
+                    line.name, threadCount, i % CanvasSize, i / CanvasSize);
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    struct ClippedLine {
+        Line line;
+        // 塗ってよい範囲（left <= x, top <= y）
+        int left;
+        int top;
+    };
+
+    // 左右の端を横切り、一部が下の外に出る線
+    const ClippedLine ClippedLines[] = {
+        { { "left edge into bottom", -10, 400, 10, 200, 2 }, 0, 198 },
+        { { "right edge grazing bottom", 240, 250, 270, 262, 3 }, 238, 247 },
+    };
+
+    // 画像の中の部分だけを塗る
+    int CheckClippedLine(const ClippedLine& clipped, int threadCount)
+    {
+        const Line& line = clipped.line;
+        SoftwareCanvas canvas(CanvasSize, CanvasSize, threadCount);
+        canvas.Clear(Background);
+        uint32_t background = canvas.Pixels()[0];
+
+        float xs[] = { line.x0, line.x1 };
+        float ys[] = { line.y0, line.y1 };
+        canvas.DrawPolyline(xs, ys, 2, Stroke, line.strokeWidth);
+
+        bool drawn = false;
+        for (int y = 0; y < CanvasSize; y++) {
+            for (int x = 0; x < CanvasSize; x++) {
+                bool changed = canvas.Pixels()[y * CanvasSize + x] != background;
+                if (changed && (x < clipped.left || y < clipped.top)) {
+                    std::fprintf(stderr, "SoftwareCanvas: %s (%d threads) changed pixel (%d, %d)\n",
+                        line.name, threadCount, x, y);
+                    return 1;
+                }
+                drawn = drawn || changed;
+            }
+        }
+        if (!drawn) {
+            std::fprintf(stderr, "SoftwareCanvas: %s (%d threads) drew nothing\n", line.name, threadCount);
+            return 1;
+        }
+        return 0;
+    }
+
+    // 手分けして塗るかを確かめる画像の大きさ
+    const int BandedWidth = 1024;
+    const int BandedHeight = 512;
+
+    // 上下に大きく振れる長い折れ線を、threadCount 個のスレッドで描いた画素
+    // 線分 1 本の輪郭が数十の帯を通るので、帯に振り分けた辺は SoftwareCanvas が手分けして塗り始める数（4096）をはるかに超える
+    std::vector<uint32_t> DrawBanded(int threadCount)
+    {
+        const int count = 2000;
+        std::vector<float> xs(count);
+        std::vector<float> ys(count);
+        for (int i = 0; i < count; i++) {
+            xs[i] = -8 + (BandedWidth + 16) * static_cast<float>(i) / (count - 1);
+            ys[i] = BandedHeight / 2 + (BandedHeight / 2 + 20) * std::sin(i * 0.9f) * std::cos(i * 0.013f);
+        }
+
+        SoftwareCanvas canvas(BandedWidth, BandedHeight, threadCount);
+        canvas.Clear(Background);
+        canvas.DrawPolyline(xs.data(), ys.data(), count, GraphColor{ 0.2f, 0.4f, 0.8f, 0.7f }, 1.5f);
+        return std::vector<uint32_t>(canvas.Pixels(), canvas.Pixels() + BandedWidth * BandedHeight);
+    }
+
+    // 帯を手分けして塗っても、スレッドの数によらず 1 スレッドで塗ったのと同じ画素になる
+    int CheckBandedDeterminism()
+    {
+        std::vector<uint32_t> expected = DrawBanded(1);
+
+        int failures = 0;
+        for (int threadCount : { 2, 3, 8 }) {
+            std::vector<uint32_t> pixels = DrawBanded(threadCount);
+            for (int i = 0; i < BandedWidth * BandedHeight; i++) {
+                if (pixels[i] != expected[i]) {
+                    std::fprintf(stderr, "SoftwareCanvas: %d threads differ from 1 thread at pixel (%d, %d)\n",
+                        threadCount, i % BandedWidth, i / BandedWidth);
+                    failures++;
+                    break;
+                }
+            }
+        }
+        return failures;
+    }
+}
+
+int CheckSoftwareCanvas()
+{
+    int failures = 0;
+    for (int threadCount : { 1, 4 }) {
+        for (const Line& line : OutsideLines) {
+            failures += CheckOutsideLine(line, threadCount);
+        }
+        for (const ClippedLine& clipped : ClippedLines) {
+            failures += CheckClippedLine(clipped, threadCount);
+        }
+    }
+    failures += CheckBandedDeterminism();
+    return failures;
+}
@@ -0,0 +1,557 @@
+﻿#include "SoftwareCanvas.h"
+
+// C++ ライブラリ
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <utility>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define GRAPHVIEWER_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+    // 角の継ぎ目の尖った先の長さが、線の太さの半分のこの倍を超えたら面取りにする（Direct2D の既定と同じ）
+    const float MiterLimit = 10.0f;
+
+    // これより短い線分は向きが決まらないので、前の点と同じ点とみなす（px）
+    const float MinSegmentLength = 1e-4f;
+
+    // 角の外側に空く隙間がこれより狭ければ、継ぎ目を置かない（px^2）
+    // 隙間は画素の被覆率を 8 ビットの半分の段階も変えないので、滑らかな曲線の 1px ごとの角で辺を増やさずに済む
+    const float MinJoinArea = 0.5f / 255;
+
+    // 帯 1 つの行数
+    const int BandRows = 16;
+
+    // 帯に振り分けた辺がこれ以上あれば、帯を複数のスレッドで手分けして塗る
+    // 1 回起こして待つのにかかる時間（数十 μs）で塗れる辺の数の目安
+    const size_t ParallelMinEdges = 4096;
+
+    // 被覆率の増分に印をつける区切りの画素数（4 の倍数）
+    const int ChunkPixels = 8;
+
+    // 印を詰めて持つ 1 語のビット数
+    const int ChunksPerWord = 32;
+
+    // 不透明度がこれ未満なら塗らず、1 からこれ以内なら色をそのまま書く
+    // 8 ビットの画素では半分の段階に満たない違いなので、丸めた結果は変わらない
+    // 累積した被覆率は線の外でも丸め誤差で 0 にならないので、これがないと行全体を塗ることになる
+    const float CoverageEpsilon = 0.5f / 255;
+
+    GraphPoint operator+(GraphPoint a, GraphPoint b) { return GraphPoint{ a.x + b.x, a.y + b.y }; }
+    GraphPoint operator-(GraphPoint a, GraphPoint b) { return GraphPoint{ a.x - b.x, a.y - b.y }; }
+    GraphPoint operator*(GraphPoint a, float s) { return GraphPoint{ a.x * s, a.y * s }; }
+
+    inline int CountTrailingZeros(unsigned int mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    uint32_t PackPixel(float b, float g, float r, float a)
+    {
+        auto channel = [](float v) { return static_cast<uint32_t>(std::lrint(std::max(0.0f, std::min(255.0f, v)))); };
+        return channel(b) | (channel(g) << 8) | (channel(r) << 16) | (channel(a) << 24);
+    }
+
+    // 塗る色
+    struct FillColor {
+        // B, G, R, A の順に 0 ～ 255（アルファは乗算せず、A は 255）
+        float target[4];
+        // 不透明度
+        float alpha;
+        // 不透明度 1 で完全に覆ったときの画素
+        uint32_t solid;
+    };
+
+    FillColor MakeFillColor(GraphColor color)
+    {
+        FillColor fill = { { color.b * 255, color.g * 255, color.r * 255, 255.0f }, std::max(0.0f, std::min(1.0f, color.a)), 0 };
+        fill.solid = PackPixel(fill.target[0], fill.target[1], fill.target[2], fill.target[3]);
+        return fill;
+    }
+
+    // 乗算済みの画素 pixel の上に、色を不透明度 k で重ねる
+    uint32_t BlendPixel(uint32_t pixel, const FillColor& fill, float k)
+    {
+        uint32_t result = 0;
+        for (int c = 0; c < 4; c++) {
+            float d = static_cast<float>((pixel >> (8 * c)) & 0xFF);
+            float v = d + (fill.target[c] - d) * k;
+            result |= static_cast<uint32_t>(std::lrint(v)) << (8 * c);
+        }
+        return result;
+    }
+
+#ifdef GRAPHVIEWER_SSE2
+    // 4 画素 pixels に、画素ごとの不透明度 k で色 target を重ねる
+    __m128i BlendPixels(__m128i pixels, __m128 k, __m128 target)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        auto blend = [target](__m128i p, __m128 weight) {
+            __m128 d = _mm_cvtepi32_ps(p);
+            return _mm_cvtps_epi32(_mm_add_ps(d, _mm_mul_ps(_mm_sub_ps(target, d), weight)));
+        };
+
+        __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+        __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+        __m128i p0 = blend(_mm_unpacklo_epi16(lo, zero), _mm_shuffle_ps(k, k, _MM_SHUFFLE(0, 0, 0, 0)));
+        __m128i p1 = blend(_mm_unpackhi_epi16(lo, zero), _mm_shuffle_ps(k, k, _MM_SHUFFLE(1, 1, 1, 1)));
+        __m128i p2 = blend(_mm_unpacklo_epi16(hi, zero), _mm_shuffle_ps(k, k, _MM_SHUFFLE(2, 2, 2, 2)));
+        __m128i p3 = blend(_mm_unpackhi_epi16(hi, zero), _mm_shuffle_ps(k, k, _MM_SHUFFLE(3, 3, 3, 3)));
+        return _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+    }
+#endif
+
+    // count 画素を同じ不透明度 k で塗る（被覆率が変わらない区間）
+    void FillSpan(uint32_t* pixels, int count, float k, const FillColor& fill)
+    {
+        if (k < CoverageEpsilon) return;
+        if (k > 1 - CoverageEpsilon) {
+            std::fill(pixels, pixels + count, fill.solid);
+            return;
+        }
+
+        int x = 0;
+#ifdef GRAPHVIEWER_SSE2
+        const __m128 target = _mm_loadu_ps(fill.target);
+        const __m128 weight = _mm_set1_ps(k);
+        for (; x + 4 <= count; x += 4) {
+            __m128i* p = reinterpret_cast<__m128i*>(pixels + x);
+            _mm_storeu_si128(p, BlendPixels(_mm_loadu_si128(p), weight, target));
+        }
+#endif
+        for (; x < count; x++) {
+            pixels[x] = BlendPixel(pixels[x], fill, k);
+        }
+    }
+
+    // 増分 deltas を sum から累積した被覆率で count 画素を塗り、最後の累積値を返す
+    float ResolveSpan(const float* deltas, uint32_t* pixels, int count, float sum, const FillColor& fill)
+    {
+        int x = 0;
+
+#ifdef GRAPHVIEWER_SSE2
+        // 4 画素ずつ累積して塗る
+        // 累積は 4 個の中で 2 回ずらして足し、前の 4 個の合計を足す
+        const __m128 target = _mm_loadu_ps(fill.target);
+        const __m128 alpha = _mm_set1_ps(fill.alpha);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        const __m128 transparent = _mm_set1_ps(CoverageEpsilon);
+        const __m128 opaque = _mm_set1_ps(1 - CoverageEpsilon);
+        const __m128i solid = _mm_set1_epi32(static_cast<int>(fill.solid));
+        __m128 carry = _mm_set1_ps(sum);
+
+        for (; x + 4 <= count; x += 4) {
+            __m128 v = _mm_loadu_ps(deltas + x);
+            v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 4)));
+            v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 8)));
+            v = _mm_add_ps(v, carry);
+            carry = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+
+            __m128 k = _mm_mul_ps(_mm_min_ps(_mm_andnot_ps(signMask, v), one), alpha);
+            if (_mm_movemask_ps(_mm_cmpge_ps(k, transparent)) == 0) continue;
+
+            // 線の内側で 4 画素とも覆われていれば、色をそのまま書く
+            __m128i* p = reinterpret_cast<__m128i*>(pixels + x);
+            if (_mm_movemask_ps(_mm_cmpgt_ps(k, opaque)) == 0xF) {
+                _mm_storeu_si128(p, solid);
+            } else {
+                _mm_storeu_si128(p, BlendPixels(_mm_loadu_si128(p), k, target));
+            }
+        }
+        sum = _mm_cvtss_f32(carry);
+#endif
+
+        for (; x < count; x++) {
+            sum += deltas[x];
+            float k = std::min(std::fabs(sum), 1.0f) * fill.alpha;
+            if (k > 1 - CoverageEpsilon) {
+                pixels[x] = fill.solid;
+            } else if (k >= CoverageEpsilon) {
+                pixels[x] = BlendPixel(pixels[x], fill, k);
+            }
+        }
+        return sum;
+    }
+}
+
+// 帯 1 つ分（BandRows 行）の被覆率の増分
+// 右端の外に寄せた辺の分を入れるため、1 行に 2 個余分に持つ
+// 1 行を ChunkPixels 個ずつに区切り、増分を足した区切りにビットで印をつける
+// 印のない区切りの被覆率は左から累積した値のままなので、画素ごとに累積せずに塗るか読み飛ばす
+struct SoftwareCanvas::CoverageBand {
+    int width;
+    int stride;
+    // 1 行の印の語数
+    int words;
+    std::vector<float> deltas;
+    std::vector<uint32_t> touched;
+    // 増分を足した行の上下の端（帯の中での行）
+    int top;
+    int bottom;
+
+    explicit CoverageBand(int imageWidth)
+        : width(imageWidth),
+        stride(imageWidth + 2),
+        words((imageWidth + 2 + ChunkPixels * ChunksPerWord - 1) / (ChunkPixels * ChunksPerWord)),
+        deltas(static_cast<size_t>(stride) * BandRows),
+        touched(static_cast<size_t>(words) * BandRows),
+        top(INT_MAX),
+        bottom(-1)
+    {
+    }
+
+    // 辺の bandTop <= y < bandBottom の部分を足す（bandBottom - bandTop <= BandRows）
+    void Accumulate(const Edge& edge, int bandTop, int bandBottom);
+
+    // 累積した被覆率で色を塗り、増分を 0 に戻す
+    // pixels は帯の最初の行の先頭
+    void Fill(uint32_t* pixels, const FillColor& fill);
+};
+
+SoftwareCanvas::SoftwareCanvas(int width, int height, int threadCount)
+    : m_width(std::max(width, 0)),
+    m_height(std::max(height, 0)),
+    m_pixels(static_cast<size_t>(m_width) * m_height),
+    m_pool(threadCount)
+{
+    for (int worker = 0; worker < m_pool.ThreadCount(); worker++) {
+        m_coverage.emplace_back(new CoverageBand(m_width));
+    }
+}
+
+SoftwareCanvas::~SoftwareCanvas()
+{
+}
+
+void SoftwareCanvas::Clear(GraphColor color)
+{
+    uint32_t pixel = PackPixel(color.b * color.a * 255, color.g * color.a * 255, color.r * color.a * 255, color.a * 255);
+    std::fill(m_pixels.begin(), m_pixels.end(), pixel);
+}
+
+void SoftwareCanvas::DrawPolyline(const float* xs, const float* ys, int count, GraphColor color, float strokeWidth)
+{
+    if (count < 2 || !(strokeWidth > 0) || m_width == 0 || m_height == 0) return;
+
+    // 輪郭をすべて作って帯ごとに振り分けてから、帯ごとにまとめて被覆率に足して 1 回だけ塗る
+    m_edges.clear();
+    AddStroke(xs, ys, count, strokeWidth / 2);
+    if (m_edges.empty()) return;
+    BinEdges();
+
+    const FillColor fill = MakeFillColor(color);
+    auto rasterize = [this, &fill](int worker, int index) {
+        CoverageBand& coverage = *m_coverage[worker];
+        int band = m_activeBands[index];
+        int top = band * BandRows;
+        int bottom = std::min(top + BandRows, m_height);
+        for (int i = m_bandStart[band]; i < m_bandStart[band + 1]; i++) {
+            coverage.Accumulate(m_edges[m_bandEdges[i]], top, bottom);
+        }
+        coverage.Fill(&m_pixels[static_cast<size_t>(top) * m_width], fill);
+    };
+
+    // 辺が少なければ、スレッドを起こして待つ時間のほうが塗る時間より長い
+    int bands = static_cast<int>(m_activeBands.size());
+    if (m_bandEdges.size() < ParallelMinEdges) {
+        for (int index = 0; index < bands; index++) {
+            rasterize(0, index);
+        }
+    } else {
+        m_pool.Run(bands, rasterize);
+    }
+}
+
+void SoftwareCanvas::AddStroke(const float* xs, const float* ys, int count, float halfWidth)
+{
+    // 線分ごとに太さ分の四角形を置き、曲がる角の外側に空く隙間を継ぎ目で埋める
+    // 内側で四角形が重なる部分は、被覆率を 1 で打ち切るので濃くならない
+    // ただし重なりの縁が画素の一部だけを覆うところは、重なった分だけ少し濃くなる
+    // 端は平ら（Direct2D の既定と同じ）
+    bool hasPoint = false;
+    bool hasSegment = false;
+    GraphPoint previous = {};
+    GraphPoint previousDirection = {};
+    GraphPoint previousNormal = {};
+
+    for (int i = 0; i < count; i++) {
+        GraphPoint p = { xs[i], ys[i] };
+
+        // NaN などの点では線を切る
+        if (!std::isfinite(p.x) || !std::isfinite(p.y)) {
+            hasPoint = false;
+            hasSegment = false;
+            continue;
+        }
+        if (!hasPoint) {
+            previous = p;
+            hasPoint = true;
+            continue;
+        }
+
+        GraphPoint d = p - previous;
+        float length = std::sqrt(d.x * d.x + d.y * d.y);
+        if (!(length > MinSegmentLength)) continue;
+
+        GraphPoint u = d * (1 / length);
+        GraphPoint n = { -u.y * halfWidth, u.x * halfWidth };
+        if (hasSegment) AddJoin(previous, previousDirection, u, previousNormal, n);
+
+        GraphPoint quad[] = { previous + n, p + n, p - n, previous - n };
+        AddPolygon(quad, 4);
+
+        previous = p;
+        previousDirection = u;
+        previousNormal = n;
+        hasSegment = true;
+    }
+}
+
+void SoftwareCanvas::AddJoin(GraphPoint p, GraphPoint u0, GraphPoint u1, GraphPoint n0, GraphPoint n1)
+{
+    float cross = u0.x * u1.y - u0.y * u1.x;
+    float dot = u0.x * u1.x + u0.y * u1.y;
+
+    // 曲がる角度を θ とすると、隙間を埋める継ぎ目の面積は (線の太さの半分)^2 * tan(θ / 2) = |n0|^2 * |cross| / (1 + dot)
+    if (dot > 0 && (n0.x * n0.x + n0.y * n0.y) * std::fabs(cross) < MinJoinArea * (1 + dot)) return;
+
+    // 法線の側に曲がるなら、隙間は反対側に空く
+    float side = cross > 0 ? -1.0f : 1.0f;
+    GraphPoint a = p + n0 * side;
+    GraphPoint b = p + n1 * side;
+
+    // 尖った先は 2 本の線の外側の縁を延ばして交わる点
+    // 先までの長さと線の太さの半分の比は sqrt(2 / (1 + dot))
+    if (1 + dot > 0 && 2 / (1 + dot) <= MiterLimit * MiterLimit) {
+        GraphPoint tip = p + (n0 + n1) * (side / (1 + dot));
+        GraphPoint miter[] = { p, a, tip, b };
+        AddPolygon(miter, 4);
+    } else {
+        GraphPoint bevel[] = { p, a, b };
+        AddPolygon(bevel, 3);
+    }
+}
+
+void SoftwareCanvas::AddPolygon(const GraphPoint* points, int count)
+{
+    // 線分の四角形は符号つき面積が負になる向きに作っているので、ほかの多角形もそれに合わせる
+    float area = 0;
+    for (int i = 0; i < count; i++) {
+        GraphPoint a = points[i];
+        GraphPoint b = points[(i + 1) % count];
+        area += a.x * b.y - b.x * a.y;
+    }
+
+    for (int i = 0; i < count; i++) {
+        GraphPoint a = points[i];
+        GraphPoint b = points[(i + 1) % count];
+        if (area > 0) std::swap(a, b);
+        AddEdge(a, b);
+    }
+}
+
+void SoftwareCanvas::AddEdge(GraphPoint a, GraphPoint b)
+{
+    const float right = static_cast<float>(m_width);
+    const float bottom = static_cast<float>(m_height);
+
+    // 水平な辺と上下の外の辺は被覆率を変えない（左右の端で分けた後の部分もそれぞれ確かめる）
+    auto outside = [bottom](float y0, float y1) {
+        return y0 == y1 || std::max(y0, y1) <= 0 || std::min(y0, y1) >= bottom;
+    };
+    if (outside(a.y, b.y)) return;
+
+    // 被覆率は左から累積するので、左の外の部分は左端に寄せれば同じ行の画素すべてに効く
+    // 右の外の部分も右端に寄せて、1 行の増分の合計が 0 になるように残しておく
+    // 左右の端を横切る辺は端で分けてから寄せる
+    float ts[4];
+    int splits = 0;
+    ts[splits++] = 0;
+    if ((a.x < 0) != (b.x < 0)) ts[splits++] = -a.x / (b.x - a.x);
+    if ((a.x > right) != (b.x > right)) ts[splits++] = (right - a.x) / (b.x - a.x);
+    ts[splits++] = 1;
+    if (splits == 4 && ts[1] > ts[2]) std::swap(ts[1], ts[2]);
+
+    GraphPoint start = a;
+    for (int i = 1; i < splits; i++) {
+        GraphPoint end = i == splits - 1 ? b : a + (b - a) * ts[i];
+        Edge edge = {
+            std::max(0.0f, std::min(right, start.x)), start.y,
+            std::max(0.0f, std::min(right, end.x)), end.y
+        };
+        if (!outside(edge.y0, edge.y1)) m_edges.push_back(edge);
+        start = end;
+    }
+}
+
+void SoftwareCanvas::BinEdges()
+{
+    // 辺が通る帯の範囲
+    // AddEdge で上下の外の辺は除いてあるが、丸めで端の帯からはみ出しても帯の外に書かないように収める
+    int bands = (m_height + BandRows - 1) / BandRows;
+    auto bandRange = [this, bands](const Edge& edge, int& first, int& last) {
+        float top = std::max(0.0f, std::min(edge.y0, edge.y1));
+        float bottom = std::min(static_cast<float>(m_height), std::max(edge.y0, edge.y1));
+        first = std::min(static_cast<int>(top) / BandRows, bands - 1);
+        last = std::min(std::max(first, (static_cast<int>(std::ceil(bottom)) - 1) / BandRows), bands - 1);
+    };
+
+    // 帯ごとの辺の数を数えてから、それぞれの帯の場所に入れる
+    m_bandStart.assign(bands + 1, 0);
+    for (const Edge& edge : m_edges) {
+        int first, last;
+        bandRange(edge, first, last);
+        for (int band = first; band <= last; band++) {
+            m_bandStart[band + 1]++;
+        }
+    }
+    for (int band = 0; band < bands; band++) {
+        m_bandStart[band + 1] += m_bandStart[band];
+    }
+
+    m_bandEdges.resize(m_bandStart[bands]);
+    for (int i = 0; i < static_cast<int>(m_edges.size()); i++) {
+        int first, last;
+        bandRange(m_edges[i], first, last);
+        for (int band = first; band <= last; band++) {
+            m_bandEdges[m_bandStart[band]++] = i;
+        }
+    }
+
+    // 入れながら進めた先頭を戻す
+    for (int band = bands; band > 0; band--) {
+        m_bandStart[band] = m_bandStart[band - 1];
+    }
+    m_bandStart[0] = 0;
+
+    m_activeBands.clear();
+    for (int band = 0; band < bands; band++) {
+        if (m_bandStart[band] != m_bandStart[band + 1]) m_activeBands.push_back(band);
+    }
+}
+
+void SoftwareCanvas::CoverageBand::Accumulate(const Edge& edge, int bandTop, int bandBottom)
+{
+    const float right = static_cast<float>(width);
+
+    // 上から下へたどり、下向きの辺は正、上向きの辺は負の被覆率を足す
+    float x0 = edge.x0, y0 = edge.y0, x1 = edge.x1, y1 = edge.y1;
+    float direction = 1;
+    if (y0 > y1) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+        direction = -1;
+    }
+
+    // 帯の上の縁から始める
+    float dxdy = (x1 - x0) / (y1 - y0);
+    float start = std::max(y0, static_cast<float>(bandTop));
+    float x = x0 + (start - y0) * dxdy;
+
+    int first = static_cast<int>(start);
+    int last = std::min(bandBottom, static_cast<int>(std::ceil(y1)));
+    if (first < last) {
+        top = std::min(top, first - bandTop);
+        bottom = std::max(bottom, last - 1 - bandTop);
+    }
+
+    for (int y = first; y < last; y++) {
+        // この行の中で辺が通る高さと、行の下の縁での x
+        float dy = std::min(static_cast<float>(y + 1), y1) - std::max(static_cast<float>(y), y0);
+        float xNext = x + dxdy * dy;
+        float d = dy * direction;
+
+        float xa = std::max(0.0f, std::min(right, x));
+        float xb = std::max(0.0f, std::min(right, xNext));
+        float left = std::min(xa, xb);
+        float rightX = std::max(xa, xb);
+        // どちらも 0 以上なので、切り捨ては整数にするだけで求まる
+        int leftIndex = static_cast<int>(left);
+        float leftFloor = static_cast<float>(leftIndex);
+        int rightIndex = static_cast<int>(rightX);
+        if (static_cast<float>(rightIndex) < rightX) rightIndex++;
+        int r = y - bandTop;
+        float* row = &deltas[static_cast<size_t>(r) * stride];
+
+        if (rightIndex <= leftIndex + 1) {
+            // 1 つの画素の中を通るなら、辺の中点より右の面積の分だけ次の画素に回す
+            float xm = 0.5f * (xa + xb) - leftFloor;
+            row[leftIndex] += d - d * xm;
+            row[leftIndex + 1] += d * xm;
+            rightIndex = leftIndex + 1;
+        } else {
+            // 複数の画素を横切るなら、画素ごとに辺の右側になる面積を台形として配る
+            float s = 1 / (rightX - left);
+            float leftFraction = left - leftFloor;
+            float a0 = 0.5f * s * (1 - leftFraction) * (1 - leftFraction);
+            float rightFraction = rightX - static_cast<float>(rightIndex) + 1;
+            float am = 0.5f * s * rightFraction * rightFraction;
+
+            row[leftIndex] += d * a0;
+            if (rightIndex == leftIndex + 2) {
+                row[leftIndex + 1] += d * (1 - a0 - am);
+            } else {
+                float a1 = s * (1.5f - leftFraction);
+                row[leftIndex + 1] += d * (a1 - a0);
+                for (int i = leftIndex + 2; i < rightIndex - 1; i++) {
+                    row[i] += d * s;
+                }
+                float a2 = a1 + (rightIndex - leftIndex - 3) * s;
+                row[rightIndex - 1] += d * (1 - a2 - am);
+            }
+            row[rightIndex] += d * am;
+        }
+
+        uint32_t* marks = &touched[static_cast<size_t>(r) * words];
+        for (int chunk = leftIndex / ChunkPixels; chunk <= rightIndex / ChunkPixels; chunk++) {
+            marks[chunk / ChunksPerWord] |= 1u << (chunk % ChunksPerWord);
+        }
+        x = xNext;
+    }
+}
+
+void SoftwareCanvas::CoverageBand::Fill(uint32_t* pixels, const FillColor& fill)
+{
+    for (int y = top; y <= bottom; y++) {
+        float* rowDeltas = &deltas[static_cast<size_t>(y) * stride];
+        uint32_t* rowPixels = &pixels[static_cast<size_t>(y) * width];
+        uint32_t* marks = &touched[static_cast<size_t>(y) * words];
+
+        // 印のついた区切りだけ増分を累積して塗る
+        // 最初の印より左の増分は 0 で、最後の印より右の被覆率は 0 に戻っている（輪郭は閉じているので、1 行の増分の合計は 0）
+        float sum = 0;
+        int next = 0;
+        for (int word = 0; word < words; word++) {
+            for (uint32_t bits = marks[word]; bits != 0; bits &= bits - 1) {
+                int left = (word * ChunksPerWord + CountTrailingZeros(bits)) * ChunkPixels;
+
+                // 前の印からここまでは被覆率が変わらないので、太い線の中なら塗りつぶし、線の外なら読み飛ばす
+                if (left > next && next < width) {
+                    FillSpan(rowPixels + next, std::min(left, width) - next, std::min(std::fabs(sum), 1.0f) * fill.alpha, fill);
+                }
+
+                int count = std::min(ChunkPixels, width - left);
+                if (count > 0) sum = ResolveSpan(rowDeltas + left, rowPixels + left, count, sum, fill);
+                std::fill(rowDeltas + left, rowDeltas + std::min(left + ChunkPixels, stride), 0.0f);
+                next = left + ChunkPixels;
+            }
+            marks[word] = 0;
+        }
+    }
+
+    top = INT_MAX;
+    bottom = -1;
+}
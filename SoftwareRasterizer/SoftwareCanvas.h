@@ -0,0 +1,83 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Canvas.h"
+#include "WorkerPool.h"
+
+// メモリ上の画像に描く GraphCanvas（GPU も Windows も使わないので、ヘッドレス描画に使う）
+// Windows のアプリ（GraphViewer）には入れず、SoftwareRasterizer ライブラリとしてヘッドレス描画や GraphViewerChecks からリンクする
+// 画素は 32 ビットの BGRA で、色はアルファを乗算済み（WIC の GUID_WICPixelFormat32bppPBGRA と同じ並び）
+//
+// 折れ線は線分ごとに塗らずに、線全体の輪郭（線分ごとの四角形と角の継ぎ目）を被覆率のバッファに足し込んでから、
+// 最後に 1 回だけ色を塗る。線分が重なる角を二重に塗って濃くしたり、継ぎ目に隙間を空けたりしない
+// 被覆率は輪郭の辺が画素を横切る面積を符号つきで足しておき、行ごとに左から累積して求める（アンチエイリアスも同時に決まる）
+// 画像は数行ずつの帯に分け、輪郭の辺を帯ごとに振り分けてから帯ごとに塗る（被覆率のバッファは帯 1 つ分で済み、キャッシュに収まる）
+// 帯どうしは別の行に書くので、複数のスレッドで手分けして塗る
+// 帯の区切りは決まった行数で、帯の中では振り分けた順に辺を足すので、スレッドの数や順番によらず同じ画素になる
+class SoftwareCanvas : public GraphCanvas {
+public:
+    // threadCount は描くのに使うスレッドの数（0 ならプロセッサの数、1 なら呼んだスレッドだけで描く）
+    SoftwareCanvas(int width, int height, int threadCount = 0);
+    ~SoftwareCanvas();
+
+    int Width() const { return m_width; }
+    int Height() const { return m_height; }
+
+    // 左上から 1 行 Width() 画素ずつ並んだ画素
+    const uint32_t* Pixels() const { return m_pixels.data(); }
+
+    void Clear(GraphColor color) override;
+    void DrawPolyline(const float* xs, const float* ys, int count, GraphColor color, float strokeWidth) override;
+
+private:
+    SoftwareCanvas(const SoftwareCanvas&) = delete;
+    SoftwareCanvas& operator=(const SoftwareCanvas&) = delete;
+
+    // 輪郭の辺（左右は画像の幅に収めてある）
+    struct Edge {
+        float x0;
+        float y0;
+        float x1;
+        float y1;
+    };
+
+    // 帯 1 つ分の被覆率の増分
+    struct CoverageBand;
+
+    // 点 (xs[i], ys[i]) を結ぶ幅 2 * halfWidth の線の輪郭を m_edges に入れる
+    void AddStroke(const float* xs, const float* ys, int count, float halfWidth);
+
+    // 点 p で、向き u0 の線分から向き u1 の線分に曲がる角の継ぎ目を m_edges に入れる
+    // n0, n1 はそれぞれの線分の左側への法線（長さは線の太さの半分）
+    void AddJoin(GraphPoint p, GraphPoint u0, GraphPoint u1, GraphPoint n0, GraphPoint n1);
+
+    // 多角形の辺を m_edges に入れる
+    // 重なった部分が打ち消し合わないように、向きはすべて同じにそろえる
+    void AddPolygon(const GraphPoint* points, int count);
+
+    // 辺 a-b を m_edges に入れる
+    // 画像の左右の外に出る部分は、画像の端の縦の辺に置き換える
+    void AddEdge(GraphPoint a, GraphPoint b);
+
+    // m_edges の辺を、通る帯ごとに m_bandEdges に振り分け、辺の通る帯を m_activeBands に入れる
+    void BinEdges();
+
+    int m_width;
+    int m_height;
+    std::vector<uint32_t> m_pixels;
+
+    // 描いている折れ線の輪郭（折れ線ごとに使い回す）
+    std::vector<Edge> m_edges;
+    // 帯 b を通る辺の m_edges での位置は m_bandEdges[m_bandStart[b]] から m_bandEdges[m_bandStart[b + 1] - 1]
+    std::vector<int> m_bandStart;
+    std::vector<int> m_bandEdges;
+    // 辺の通る帯（上から順）
+    std::vector<int> m_activeBands;
+
+    WorkerPool m_pool;
+    // スレッドごとの被覆率（m_coverage[worker]）
+    std::vector<std::unique_ptr<CoverageBand>> m_coverage;
+};
@@ -0,0 +1,96 @@
+﻿#include "WorkerPool.h"
+
+// C++ ライブラリ
+#include <algorithm>
+
+WorkerPool::WorkerPool(int threadCount)
+    : m_stopRequested(false),
+    m_generation(0),
+    m_busy(0),
+    m_task(nullptr),
+    m_count(0),
+    m_next(0)
+{
+    if (threadCount <= 0) {
+        threadCount = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    }
+
+    // Run を呼んだスレッドも手分けに加わるので、作るのは 1 つ少なくてよい
+    for (int worker = 1; worker < threadCount; worker++) {
+        m_threads.emplace_back(&WorkerPool::ThreadMain, this, worker);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopRequested = true;
+    }
+
+    m_wake.notify_all();
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::Run(int count, const std::function<void(int, int)>& task)
+{
+    if (count <= 0) return;
+
+    // 仕事が 1 つしかなければ、スレッドを起こすより自分で実行したほうが速い
+    if (m_threads.empty() || count == 1) {
+        for (int index = 0; index < count; index++) {
+            task(0, index);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &task;
+        m_count = count;
+        m_next = 0;
+        m_busy = static_cast<int>(m_threads.size());
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    Work(0);
+
+    // 遅れて起きたスレッドが古い m_task を使わないように、全部のスレッドが実行し終わるまで待つ
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_busy == 0; });
+    m_task = nullptr;
+}
+
+void WorkerPool::ThreadMain(int worker)
+{
+    uint64_t generation = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this, generation] { return m_generation != generation || m_stopRequested; });
+            if (m_stopRequested) break;
+
+            generation = m_generation;
+        }
+
+        Work(worker);
+
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            last = --m_busy == 0;
+        }
+        if (last) m_done.notify_one();
+    }
+}
+
+void WorkerPool::Work(int worker)
+{
+    for (int index; (index = m_next.fetch_add(1)) < m_count; ) {
+        (*m_task)(worker, index);
+    }
+}
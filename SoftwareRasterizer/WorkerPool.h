@@ -0,0 +1,52 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 決まった数のスレッドを持ち続け、番号をつけた仕事を手分けして実行する
+// 呼ぶたびにスレッドを作ると、1 フレームに何度も呼ぶ描画ではスレッドを作る時間のほうが長くなる
+class WorkerPool {
+public:
+    // threadCount は Run を呼んだスレッドも含めた数（0 ならプロセッサの数）
+    explicit WorkerPool(int threadCount);
+    ~WorkerPool();
+
+    // Run を呼んだスレッドも含めたスレッドの数
+    int ThreadCount() const { return static_cast<int>(m_threads.size()) + 1; }
+
+    // task(worker, index) を index = 0 ～ count - 1 について 1 回ずつ実行し、すべて終わるまで待つ
+    // worker は実行したスレッドの番号（0 ～ ThreadCount() - 1、Run を呼んだスレッドは 0）で、スレッドごとの作業領域を選ぶのに使う
+    // どの index をどのスレッドが実行するかは決まっていないので、結果が index だけで決まるようにしておく
+    void Run(int count, const std::function<void(int, int)>& task);
+
+private:
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    void ThreadMain(int worker);
+
+    // 次に実行する index を取り出して、なくなるまで実行する
+    void Work(int worker);
+
+    // 以下は m_mutex で守る
+    // Run のたびに m_generation を増やして、スレッドを起こす
+    // スレッドは起きるたびに、実行し終わったら m_busy を減らす
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    bool m_stopRequested;
+    uint64_t m_generation;
+    int m_busy;
+
+    // 実行中の仕事（Run が返るまで変えない）
+    const std::function<void(int, int)>* m_task;
+    int m_count;
+    std::atomic<int> m_next;
+
+    std::vector<std::thread> m_threads;
+};